@@ -0,0 +1,160 @@
+// *****************************************************************************
+    // include emulator headers
+    #include "AudioOutput.hpp"
+    
+    // include C/C++ headers
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    
+    // declare used namespaces
+    using namespace std;
+    using namespace V32;
+// *****************************************************************************
+
+
+// the ring is indexed with a mask, so this must hold
+static_assert( (AUDIO_RING_SIZE & (AUDIO_RING_SIZE - 1)) == 0, "Audio ring size must be a power of 2" );
+
+
+// =============================================================================
+//      AUDIO OUTPUT: INSTANCE HANDLING
+// =============================================================================
+
+
+AudioOutput::AudioOutput()
+{
+    RingSamples.resize( AUDIO_RING_SIZE );
+    ReadPosition = 0;
+    WritePosition = 0;
+    ResetStatistics();
+}
+
+
+// =============================================================================
+//      AUDIO OUTPUT: PRODUCER SIDE
+// =============================================================================
+
+
+unsigned AudioOutput::PushSamples( const SPUSample* Samples, unsigned NumberOfSamples )
+{
+    // only this thread writes the write position
+    unsigned Write = WritePosition.load( memory_order_relaxed );
+    unsigned Read = ReadPosition.load( memory_order_acquire );
+    
+    // when the ring is full, newest samples are dropped:
+    // this keeps the consumer reading a continuous signal
+    unsigned FreeSamples = AUDIO_RING_SIZE - (Write - Read);
+    unsigned PushedSamples = min( NumberOfSamples, FreeSamples );
+    
+    if( PushedSamples < NumberOfSamples )
+      DroppedSamples.store( DroppedSamples.load( memory_order_relaxed ) + (NumberOfSamples - PushedSamples), memory_order_relaxed );
+    
+    // copy in up to 2 parts, since the ring may wrap around
+    unsigned Start = Write & (AUDIO_RING_SIZE - 1);
+    unsigned FirstPart = min( PushedSamples, AUDIO_RING_SIZE - Start );
+    memcpy( &RingSamples[ Start ], Samples, FirstPart * sizeof(SPUSample) );
+    memcpy( &RingSamples[ 0 ], Samples + FirstPart, (PushedSamples - FirstPart) * sizeof(SPUSample) );
+    
+    // publish the samples to the consumer
+    WritePosition.store( Write + PushedSamples, memory_order_release );
+    
+    // the producer keeps track of the highest occupancy
+    unsigned Occupancy = Write + PushedSamples - Read;
+    
+    if( Occupancy > MaximumOccupancy.load( memory_order_relaxed ) )
+      MaximumOccupancy.store( Occupancy, memory_order_relaxed );
+    
+    return PushedSamples;
+}
+
+
+// =============================================================================
+//      AUDIO OUTPUT: CONSUMER SIDE
+// =============================================================================
+
+
+unsigned AudioOutput::PopSamples( SPUSample* Samples, unsigned NumberOfSamples )
+{
+    // only this thread writes the read position
+    unsigned Read = ReadPosition.load( memory_order_relaxed );
+    unsigned Write = WritePosition.load( memory_order_acquire );
+    
+    unsigned AvailableSamples = Write - Read;
+    unsigned PoppedSamples = min( NumberOfSamples, AvailableSamples );
+    
+    if( PoppedSamples < NumberOfSamples )
+      Underruns.store( Underruns.load( memory_order_relaxed ) + 1, memory_order_relaxed );
+    
+    // copy in up to 2 parts, since the ring may wrap around
+    unsigned Start = Read & (AUDIO_RING_SIZE - 1);
+    unsigned FirstPart = min( PoppedSamples, AUDIO_RING_SIZE - Start );
+    memcpy( Samples, &RingSamples[ Start ], FirstPart * sizeof(SPUSample) );
+    memcpy( Samples + FirstPart, &RingSamples[ 0 ], (PoppedSamples - FirstPart) * sizeof(SPUSample) );
+    
+    // release the slots back to the producer
+    ReadPosition.store( Read + PoppedSamples, memory_order_release );
+    
+    // the consumer keeps track of the lowest occupancy
+    unsigned Occupancy = AvailableSamples - PoppedSamples;
+    
+    if( Occupancy < MinimumOccupancy.load( memory_order_relaxed ) )
+      MinimumOccupancy.store( Occupancy, memory_order_relaxed );
+    
+    return PoppedSamples;
+}
+
+// -----------------------------------------------------------------------------
+
+// for when the consumer finds the ring empty and
+// outputs something else without popping samples
+void AudioOutput::CountUnderrun()
+{
+    Underruns.store( Underruns.load( memory_order_relaxed ) + 1, memory_order_relaxed );
+    MinimumOccupancy.store( 0, memory_order_relaxed );
+}
+
+
+// =============================================================================
+//      AUDIO OUTPUT: CONTROL AND METRICS
+// =============================================================================
+
+
+// only call this when the consumer is not active
+void AudioOutput::Clear()
+{
+    ReadPosition.store( WritePosition.load() );
+}
+
+// -----------------------------------------------------------------------------
+
+unsigned AudioOutput::GetOccupancy()
+{
+    // read position first, so that result is never negative
+    unsigned Read = ReadPosition.load( memory_order_acquire );
+    unsigned Write = WritePosition.load( memory_order_acquire );
+    return Write - Read;
+}
+
+// -----------------------------------------------------------------------------
+
+AudioRingStatistics AudioOutput::GetStatistics()
+{
+    AudioRingStatistics Statistics;
+    Statistics.CurrentOccupancy = GetOccupancy();
+    Statistics.MinimumOccupancy = min( MinimumOccupancy.load(), Statistics.CurrentOccupancy );
+    Statistics.MaximumOccupancy = max( MaximumOccupancy.load(), Statistics.CurrentOccupancy );
+    Statistics.Capacity = AUDIO_RING_SIZE;
+    Statistics.Underruns = Underruns.load();
+    Statistics.DroppedSamples = DroppedSamples.load();
+    return Statistics;
+}
+
+// -----------------------------------------------------------------------------
+
+void AudioOutput::ResetStatistics()
+{
+    MinimumOccupancy = AUDIO_RING_SIZE;
+    MaximumOccupancy = 0;
+    Underruns = 0;
+    DroppedSamples = 0;
+}
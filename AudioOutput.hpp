@@ -0,0 +1,89 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef AUDIOOUTPUT_HPP
+    #define AUDIOOUTPUT_HPP
+    
+    // include common Vircon headers
+    #include "VirconDefinitions/DataStructures.hpp"
+    
+    // include C/C++ headers
+    #include <atomic>           // [ C++ STL ] Atomic operations
+    #include <vector>           // [ C++ STL ] Vectors
+// *****************************************************************************
+
+
+// capacity of the ring buffer in stereo samples; it
+// must be a power of 2 (8192 samples is about 186 ms)
+#define AUDIO_RING_SIZE 8192
+
+
+// =============================================================================
+//      AUDIO RING BUFFER STATISTICS
+// =============================================================================
+
+
+typedef struct
+{
+    // occupancy given in stereo samples
+    unsigned CurrentOccupancy;
+    unsigned MinimumOccupancy;
+    unsigned MaximumOccupancy;
+    unsigned Capacity;
+    
+    // failure counters
+    unsigned Underruns;         // times the consumer found less samples than requested
+    unsigned DroppedSamples;    // samples discarded by the producer because the ring was full
+}
+AudioRingStatistics;
+
+
+// =============================================================================
+//      LOCK-FREE AUDIO RING BUFFER
+// =============================================================================
+
+
+// this is a single-producer, single-consumer queue:
+// the emulation thread pushes samples generated by the
+// SPU and the front-end audio thread pulls them; each
+// position index is only ever written by one thread
+class AudioOutput
+{
+    private:
+        
+        // sample storage
+        std::vector< V32::SPUSample > RingSamples;
+        
+        // positions grow indefinitely and are wrapped on access
+        std::atomic< unsigned > ReadPosition;
+        std::atomic< unsigned > WritePosition;
+        
+        // occupancy metrics (written by only 1 thread each)
+        std::atomic< unsigned > MinimumOccupancy;
+        std::atomic< unsigned > MaximumOccupancy;
+        std::atomic< unsigned > Underruns;
+        std::atomic< unsigned > DroppedSamples;
+        
+    public:
+        
+        // instance handling
+        AudioOutput();
+        
+        // producer side (emulation thread)
+        unsigned PushSamples( const V32::SPUSample* Samples, unsigned NumberOfSamples );
+        
+        // consumer side (front-end audio thread)
+        unsigned PopSamples( V32::SPUSample* Samples, unsigned NumberOfSamples );
+        void CountUnderrun();
+        
+        // control and metrics
+        void Clear();
+        unsigned GetOccupancy();
+        AudioRingStatistics GetStatistics();
+        void ResetStatistics();
+};
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
@@ -0,0 +1,312 @@
+// *****************************************************************************
+    // include Vircon32 headers
+    #include "VirconDefinitions/Constants.hpp"
+    
+    // include emulator headers
+    #include "AudioResampler.hpp"
+    
+    // include C/C++ headers
+    #include <cmath>            // [ ANSI C ] Mathematics
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <chrono>           // [ C++ STL ] Time measurement
+    
+    // include SIMD headers when available
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+      #define RESAMPLER_USE_SSE2
+      #include <emmintrin.h>
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      #define RESAMPLER_USE_NEON
+      #include <arm_neon.h>
+    #endif
+    
+    // declare used namespaces
+    using namespace std;
+    using namespace V32;
+// *****************************************************************************
+
+
+// =============================================================================
+//      AUXILIARY FUNCTIONS
+// =============================================================================
+
+
+// the SIMD paths are written for this tap count
+static_assert( RESAMPLER_SINC_TAPS == 16, "Sinc dot product assumes 16 taps" );
+
+// -----------------------------------------------------------------------------
+
+// dot product of 16 input samples with a kernel
+static inline float DotProduct16( const float* Samples, const float* Kernel )
+{
+    #if defined(RESAMPLER_USE_SSE2)
+      
+      __m128 Sum = _mm_mul_ps( _mm_loadu_ps( Samples ), _mm_loadu_ps( Kernel ) );
+      Sum = _mm_add_ps( Sum, _mm_mul_ps( _mm_loadu_ps( Samples +  4 ), _mm_loadu_ps( Kernel +  4 ) ) );
+      Sum = _mm_add_ps( Sum, _mm_mul_ps( _mm_loadu_ps( Samples +  8 ), _mm_loadu_ps( Kernel +  8 ) ) );
+      Sum = _mm_add_ps( Sum, _mm_mul_ps( _mm_loadu_ps( Samples + 12 ), _mm_loadu_ps( Kernel + 12 ) ) );
+      
+      // horizontal sum of the 4 lanes
+      Sum = _mm_add_ps( Sum, _mm_movehl_ps( Sum, Sum ) );
+      Sum = _mm_add_ss( Sum, _mm_shuffle_ps( Sum, Sum, 1 ) );
+      return _mm_cvtss_f32( Sum );
+    
+    #elif defined(RESAMPLER_USE_NEON)
+      
+      float32x4_t Sum = vmulq_f32( vld1q_f32( Samples ), vld1q_f32( Kernel ) );
+      Sum = vmlaq_f32( Sum, vld1q_f32( Samples +  4 ), vld1q_f32( Kernel +  4 ) );
+      Sum = vmlaq_f32( Sum, vld1q_f32( Samples +  8 ), vld1q_f32( Kernel +  8 ) );
+      Sum = vmlaq_f32( Sum, vld1q_f32( Samples + 12 ), vld1q_f32( Kernel + 12 ) );
+      
+      // horizontal sum of the 4 lanes (valid for ARMv7 too)
+      float32x2_t Pair = vadd_f32( vget_low_f32( Sum ), vget_high_f32( Sum ) );
+      return vget_lane_f32( vpadd_f32( Pair, Pair ), 0 );
+    
+    #else
+      
+      float Sum = 0;
+      
+      for( int i = 0; i < RESAMPLER_SINC_TAPS; i++ )
+        Sum += Samples[ i ] * Kernel[ i ];
+      
+      return Sum;
+    
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+static inline int16_t FloatToSample( float Value )
+{
+    long Rounded = lrintf( Value );
+    
+    if( Rounded >  32767 ) return  32767;
+    if( Rounded < -32768 ) return -32768;
+    return (int16_t)Rounded;
+}
+
+
+// =============================================================================
+//      AUDIO RESAMPLER: INSTANCE HANDLING
+// =============================================================================
+
+
+AudioResampler::AudioResampler()
+{
+    InputRate = Constants::SPUSamplingRate;
+    OutputRate = InputRate;
+    Quality = ResamplerQualities::Sinc;
+    Step = (uint64_t)1 << 32;
+    
+    ResetStatistics();
+    Reset();
+}
+
+
+// =============================================================================
+//      AUDIO RESAMPLER: CONFIGURATION
+// =============================================================================
+
+
+void AudioResampler::Configure( unsigned NewOutputRate, ResamplerQualities NewQuality )
+{
+    bool RateChanged = (NewOutputRate != OutputRate);
+    
+    OutputRate = NewOutputRate;
+    Quality = NewQuality;
+    Step = ((uint64_t)InputRate << 32) / OutputRate;
+    
+    // the filter cutoff depends on the rates
+    if( RateChanged || SincTable.empty() )
+      BuildSincTable();
+    
+    Reset();
+}
+
+// -----------------------------------------------------------------------------
+
+void AudioResampler::Reset()
+{
+    // start with silence as filter history, so that
+    // the first output sample is centered on time 0
+    unsigned Radius = GetKernelRadius();
+    PendingLeft.assign( Radius - 1, 0.0f );
+    PendingRight.assign( Radius - 1, 0.0f );
+    Position = (uint64_t)(Radius - 1) << 32;
+}
+
+// -----------------------------------------------------------------------------
+
+bool AudioResampler::IsBypassed()
+{
+    return (OutputRate == InputRate);
+}
+
+// -----------------------------------------------------------------------------
+
+unsigned AudioResampler::GetOutputRate()
+{
+    return OutputRate;
+}
+
+// -----------------------------------------------------------------------------
+
+unsigned AudioResampler::GetKernelRadius()
+{
+    if( Quality == ResamplerQualities::Linear )
+      return 1;
+    
+    return RESAMPLER_SINC_TAPS / 2;
+}
+
+// -----------------------------------------------------------------------------
+
+void AudioResampler::BuildSincTable()
+{
+    const double Pi = 3.14159265358979323846;
+    const int Radius = RESAMPLER_SINC_TAPS / 2;
+    
+    // cutoff is placed a bit below the lowest Nyquist
+    // frequency, given as a fraction of the input one
+    double Cutoff = 0.91 * min( 1.0, (double)OutputRate / InputRate );
+    
+    // 1 extra phase so that rounding never goes out of bounds
+    SincTable.resize( (RESAMPLER_SINC_PHASES + 1) * RESAMPLER_SINC_TAPS );
+    
+    for( int Phase = 0; Phase <= RESAMPLER_SINC_PHASES; Phase++ )
+    {
+        float* Kernel = &SincTable[ Phase * RESAMPLER_SINC_TAPS ];
+        double Fraction = (double)Phase / RESAMPLER_SINC_PHASES;
+        double Sum = 0;
+        
+        for( int Tap = 0; Tap < RESAMPLER_SINC_TAPS; Tap++ )
+        {
+            // distance from the output position to this input sample
+            double Distance = (Tap - (Radius - 1)) - Fraction;
+            double x = Pi * Cutoff * Distance;
+            double Sinc = (fabs( x ) < 1e-9)? 1.0 : sin( x ) / x;
+            
+            // Blackman window over the kernel span
+            double WindowPosition = Pi * Distance / Radius;
+            double Window = 0.42 + 0.5 * cos( WindowPosition ) + 0.08 * cos( 2 * WindowPosition );
+            if( fabs( Distance ) >= Radius ) Window = 0;
+            
+            Kernel[ Tap ] = (float)(Cutoff * Sinc * Window);
+            Sum += Kernel[ Tap ];
+        }
+        
+        // normalize for unity gain at DC
+        for( int Tap = 0; Tap < RESAMPLER_SINC_TAPS; Tap++ )
+          Kernel[ Tap ] = (float)(Kernel[ Tap ] / Sum);
+    }
+}
+
+
+// =============================================================================
+//      AUDIO RESAMPLER: CONVERSION
+// =============================================================================
+
+
+void AudioResampler::ResampleLinear()
+{
+    const uint64_t Limit = (uint64_t)(PendingLeft.size() - 1) << 32;
+    
+    while( Position < Limit )
+    {
+        unsigned Index = (unsigned)(Position >> 32);
+        float Fraction = (float)(Position & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+        
+        SPUSample Result;
+        Result.LeftSample  = FloatToSample( PendingLeft [ Index ] + Fraction * (PendingLeft [ Index + 1 ] - PendingLeft [ Index ]) );
+        Result.RightSample = FloatToSample( PendingRight[ Index ] + Fraction * (PendingRight[ Index + 1 ] - PendingRight[ Index ]) );
+        OutputSamples.push_back( Result );
+        
+        Position += Step;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void AudioResampler::ResampleSinc()
+{
+    const unsigned Radius = RESAMPLER_SINC_TAPS / 2;
+    const uint64_t Limit = (uint64_t)(PendingLeft.size() - Radius) << 32;
+    
+    while( Position < Limit )
+    {
+        unsigned Index = (unsigned)(Position >> 32);
+        unsigned Phase = (unsigned)(((Position & 0xFFFFFFFF) * RESAMPLER_SINC_PHASES + 0x80000000) >> 32);
+        const float* Kernel = &SincTable[ Phase * RESAMPLER_SINC_TAPS ];
+        unsigned First = Index - (Radius - 1);
+        
+        SPUSample Result;
+        Result.LeftSample  = FloatToSample( DotProduct16( &PendingLeft [ First ], Kernel ) );
+        Result.RightSample = FloatToSample( DotProduct16( &PendingRight[ First ], Kernel ) );
+        OutputSamples.push_back( Result );
+        
+        Position += Step;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+const SPUSample* AudioResampler::Process( const SPUSample* Samples, unsigned NumberOfSamples, unsigned& OutputCount )
+{
+    // nothing to do when rates match
+    if( IsBypassed() )
+    {
+        OutputCount = NumberOfSamples;
+        return Samples;
+    }
+    
+    auto StartTime = chrono::steady_clock::now();
+    
+    // append the new input
+    for( unsigned i = 0; i < NumberOfSamples; i++ )
+    {
+        PendingLeft.push_back( Samples[ i ].LeftSample );
+        PendingRight.push_back( Samples[ i ].RightSample );
+    }
+    
+    // generate all output samples that have enough input
+    OutputSamples.clear();
+    
+    if( Quality == ResamplerQualities::Linear )
+      ResampleLinear();
+    else
+      ResampleSinc();
+    
+    // discard input that will no longer be needed
+    unsigned Radius = GetKernelRadius();
+    unsigned Consumed = (unsigned)(Position >> 32) - (Radius - 1);
+    PendingLeft.erase( PendingLeft.begin(), PendingLeft.begin() + Consumed );
+    PendingRight.erase( PendingRight.begin(), PendingRight.begin() + Consumed );
+    Position -= (uint64_t)Consumed << 32;
+    
+    // update metrics
+    auto EndTime = chrono::steady_clock::now();
+    Statistics.ProcessedCalls++;
+    Statistics.InputSamples += NumberOfSamples;
+    Statistics.OutputSamples += OutputSamples.size();
+    Statistics.ProcessingNanoseconds += chrono::duration_cast< chrono::nanoseconds >( EndTime - StartTime ).count();
+    
+    OutputCount = OutputSamples.size();
+    return OutputSamples.data();
+}
+
+
+// =============================================================================
+//      AUDIO RESAMPLER: METRICS
+// =============================================================================
+
+
+ResamplerStatistics AudioResampler::GetStatistics()
+{
+    return Statistics;
+}
+
+// -----------------------------------------------------------------------------
+
+void AudioResampler::ResetStatistics()
+{
+    memset( &Statistics, 0, sizeof( Statistics ) );
+}
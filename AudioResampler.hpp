@@ -0,0 +1,115 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef AUDIORESAMPLER_HPP
+    #define AUDIORESAMPLER_HPP
+    
+    // include common Vircon headers
+    #include "VirconDefinitions/DataStructures.hpp"
+    
+    // include C/C++ headers
+    #include <vector>           // [ C++ STL ] Vectors
+    #include <stdint.h>         // [ ANSI C ] Standard integer types
+// *****************************************************************************
+
+
+// parameters for the windowed-sinc filter: number of
+// input samples used for each output sample, and number
+// of precomputed fractional positions for the kernel
+#define RESAMPLER_SINC_TAPS   16
+#define RESAMPLER_SINC_PHASES 512
+
+
+// =============================================================================
+//      RESAMPLING QUALITY
+// =============================================================================
+
+
+enum class ResamplerQualities
+{
+    Linear = 0,
+    Sinc
+};
+
+
+// =============================================================================
+//      RESAMPLING PERFORMANCE METRICS
+// =============================================================================
+
+
+typedef struct
+{
+    uint64_t ProcessedCalls;
+    uint64_t InputSamples;
+    uint64_t OutputSamples;
+    uint64_t ProcessingNanoseconds;
+}
+ResamplerStatistics;
+
+
+// =============================================================================
+//      STREAMING AUDIO RESAMPLER
+// =============================================================================
+
+
+// converts the SPU output (always 44100 Hz) to the
+// front-end's output rate, so that the front-end
+// does not need to run its own resampling pass
+class AudioResampler
+{
+    private:
+        
+        // configuration
+        unsigned InputRate;
+        unsigned OutputRate;
+        ResamplerQualities Quality;
+        
+        // input position of the next output sample, in
+        // 32.32 fixed point, relative to the pending input
+        uint64_t Position;
+        uint64_t Step;
+        
+        // input samples not yet fully consumed,
+        // separated by channel to ease vectorization
+        std::vector< float > PendingLeft;
+        std::vector< float > PendingRight;
+        
+        // polyphase kernel for the sinc filter
+        std::vector< float > SincTable;
+        
+        // results of last conversion
+        std::vector< V32::SPUSample > OutputSamples;
+        
+        // metrics
+        ResamplerStatistics Statistics;
+        
+        // internal operations
+        void BuildSincTable();
+        void ResampleLinear();
+        void ResampleSinc();
+        unsigned GetKernelRadius();
+        
+    public:
+        
+        // instance handling
+        AudioResampler();
+        
+        // configuration
+        void Configure( unsigned NewOutputRate, ResamplerQualities NewQuality );
+        void Reset();
+        bool IsBypassed();
+        unsigned GetOutputRate();
+        
+        // conversion: returned samples are valid
+        // only until the next call to Process
+        const V32::SPUSample* Process( const V32::SPUSample* Samples, unsigned NumberOfSamples, unsigned& OutputCount );
+        
+        // metrics
+        ResamplerStatistics GetStatistics();
+        void ResetStatistics();
+};
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
@@ -0,0 +1,473 @@
+// *****************************************************************************
+    // include emulator headers
+    #include "CaptureOutput.hpp"
+    #include "Logging.hpp"
+    
+    // include C/C++ headers
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <chrono>           // [ C++ STL ] Time measurement
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    
+    // declare used namespaces
+    using namespace std;
+    using namespace V32;
+// *****************************************************************************
+
+
+// size in bytes of a captured RGBA frame
+static const unsigned CaptureFrameBytes = Constants::ScreenWidth * Constants::ScreenHeight * 4;
+
+
+// =============================================================================
+//      CAPTURE OUTPUT: INSTANCE HANDLING
+// =============================================================================
+
+
+CaptureOutput::CaptureOutput()
+{
+    IsCapturing = false;
+    VideoFile = nullptr;
+    AudioFile = nullptr;
+    WrittenAudioBytes = 0;
+    StopRequested = false;
+    NextSlot = 0;
+    
+    for( int i = 0; i < CAPTURE_PIXEL_BUFFERS; i++ )
+    {
+        PixelBufferIDs[ i ] = 0;
+        SlotContents[ i ] = CaptureSlotContents::Empty;
+    }
+    
+    CapturedFrames = 0;
+    WrittenFrames = 0;
+    DroppedFrames = 0;
+    TotalOverheadMilliseconds = 0;
+    MaximumOverheadMilliseconds = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+CaptureOutput::~CaptureOutput()
+{
+    // GL objects cannot be released here, since
+    // the context may be gone: just end the writer
+    if( WriterThread.joinable() )
+    {
+        {
+            lock_guard< mutex > Lock( QueueMutex );
+            StopRequested = true;
+        }
+        
+        QueueCondition.notify_one();
+        WriterThread.join();
+    }
+}
+
+
+// =============================================================================
+//      CAPTURE OUTPUT: CAPTURE CONTROL
+// =============================================================================
+
+
+bool CaptureOutput::Start( const string& BasePath )
+{
+    if( IsCapturing )
+      return true;
+    
+    // pixel pack buffers are not available in GLES 2
+    #if defined(HAVE_OPENGLES2)
+      
+      LOG( "Capture is not supported on OpenGL ES 2" );
+      return false;
+    
+    #else
+      
+      // open both output files
+      string VideoPath = BasePath + ".y4m";
+      string AudioPath = BasePath + ".wav";
+      VideoFile = fopen( VideoPath.c_str(), "wb" );
+      AudioFile = fopen( AudioPath.c_str(), "wb" );
+      
+      if( !VideoFile || !AudioFile )
+      {
+          LOG( "ERROR: Cannot create capture files at " + BasePath );
+          if( VideoFile ) fclose( VideoFile );
+          if( AudioFile ) fclose( AudioFile );
+          VideoFile = AudioFile = nullptr;
+          return false;
+      }
+      
+      // write the file headers; the WAV
+      // header is rewritten when stopping
+      fprintf( VideoFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", Constants::ScreenWidth, Constants::ScreenHeight, Constants::FramesPerSecond );
+      WrittenAudioBytes = 0;
+      WriteWAVHeader();
+      
+      // create the pixel buffers
+      glGenBuffers( CAPTURE_PIXEL_BUFFERS, PixelBufferIDs );
+      
+      for( int i = 0; i < CAPTURE_PIXEL_BUFFERS; i++ )
+      {
+          glBindBuffer( GL_PIXEL_PACK_BUFFER, PixelBufferIDs[ i ] );
+          glBufferData( GL_PIXEL_PACK_BUFFER, CaptureFrameBytes, nullptr, GL_STREAM_READ );
+          SlotContents[ i ] = CaptureSlotContents::Empty;
+      }
+      
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+      NextSlot = 0;
+      
+      // allocate all queued frames now
+      FramePool.resize( CAPTURE_QUEUE_SIZE );
+      FreeFrames.clear();
+      QueuedFrames.clear();
+      
+      for( CaptureFrame& Frame: FramePool )
+      {
+          Frame.Pixels.resize( CaptureFrameBytes );
+          FreeFrames.push_back( &Frame );
+      }
+      
+      // reset metrics
+      CapturedFrames = 0;
+      WrittenFrames = 0;
+      DroppedFrames = 0;
+      TotalOverheadMilliseconds = 0;
+      MaximumOverheadMilliseconds = 0;
+      
+      // start writing
+      StopRequested = false;
+      LastPixels.assign( CaptureFrameBytes, 0 );
+      WriterThread = thread( &CaptureOutput::WriterLoop, this );
+      
+      IsCapturing = true;
+      LOG( "Capture started: " + VideoPath + ", " + AudioPath );
+      return true;
+    
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+void CaptureOutput::Stop()
+{
+    if( !IsCapturing )
+      return;
+    
+    #if !defined(HAVE_OPENGLES2)
+      
+      // queue all frames still held in the pixel buffers
+      for( int i = 0; i < CAPTURE_PIXEL_BUFFERS; i++ )
+      {
+          ResolveSlot( NextSlot );
+          NextSlot = (NextSlot + 1) % CAPTURE_PIXEL_BUFFERS;
+      }
+      
+      glDeleteBuffers( CAPTURE_PIXEL_BUFFERS, PixelBufferIDs );
+    
+    #endif
+    
+    // let the writer finish all queued frames
+    {
+        lock_guard< mutex > Lock( QueueMutex );
+        StopRequested = true;
+    }
+    
+    QueueCondition.notify_one();
+    WriterThread.join();
+    
+    // complete the WAV header
+    WriteWAVHeader();
+    fclose( VideoFile );
+    fclose( AudioFile );
+    VideoFile = AudioFile = nullptr;
+    
+    // release frame memory
+    FreeFrames.clear();
+    QueuedFrames.clear();
+    FramePool.clear();
+    
+    IsCapturing = false;
+    LOG( "Capture stopped" );
+}
+
+// -----------------------------------------------------------------------------
+
+bool CaptureOutput::IsActive()
+{
+    return IsCapturing;
+}
+
+
+// =============================================================================
+//      CAPTURE OUTPUT: EMULATION THREAD SIDE
+// =============================================================================
+
+
+// returns the next slot, after queuing its previous contents
+unsigned CaptureOutput::AcquireSlot()
+{
+    unsigned Slot = NextSlot;
+    NextSlot = (NextSlot + 1) % CAPTURE_PIXEL_BUFFERS;
+    ResolveSlot( Slot );
+    return Slot;
+}
+
+// -----------------------------------------------------------------------------
+
+void CaptureOutput::ResolveSlot( unsigned Slot )
+{
+    #if !defined(HAVE_OPENGLES2)
+      
+      if( SlotContents[ Slot ] == CaptureSlotContents::RenderedFrame )
+      {
+          // the read was issued some frames ago,
+          // so mapping should not need to wait
+          glBindBuffer( GL_PIXEL_PACK_BUFFER, PixelBufferIDs[ Slot ] );
+          void* Pixels = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, CaptureFrameBytes, GL_MAP_READ_BIT );
+          
+          if( Pixels )
+          {
+              QueueFrame( (const uint8_t*)Pixels, SlotSamples[ Slot ] );
+              glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+          }
+          
+          else DroppedFrames++;
+          
+          glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+      }
+      
+      else if( SlotContents[ Slot ] == CaptureSlotContents::SkippedFrame )
+        QueueFrame( nullptr, SlotSamples[ Slot ] );
+    
+    #endif
+    
+    SlotContents[ Slot ] = CaptureSlotContents::Empty;
+}
+
+// -----------------------------------------------------------------------------
+
+// never waits for the writer: if there is
+// no free frame, this frame is just dropped
+void CaptureOutput::QueueFrame( const uint8_t* Pixels, const SPUSample* Samples )
+{
+    CaptureFrame* Frame = nullptr;
+    
+    {
+        lock_guard< mutex > Lock( QueueMutex );
+        
+        if( !FreeFrames.empty() )
+        {
+            Frame = FreeFrames.front();
+            FreeFrames.pop_front();
+        }
+    }
+    
+    if( !Frame )
+    {
+        DroppedFrames++;
+        return;
+    }
+    
+    // copy outside of the lock
+    Frame->RepeatPreviousFrame = !Pixels;
+    
+    if( Pixels )
+      memcpy( Frame->Pixels.data(), Pixels, CaptureFrameBytes );
+    
+    memcpy( Frame->Samples, Samples, sizeof( Frame->Samples ) );
+    
+    {
+        lock_guard< mutex > Lock( QueueMutex );
+        QueuedFrames.push_back( Frame );
+    }
+    
+    QueueCondition.notify_one();
+}
+
+// -----------------------------------------------------------------------------
+
+void CaptureOutput::CaptureRenderedFrame( GLuint FramebufferID, const SPUOutputBuffer& Audio )
+{
+    if( !IsCapturing )
+      return;
+    
+    auto StartTime = chrono::steady_clock::now();
+    unsigned Slot = AcquireSlot();
+    
+    #if !defined(HAVE_OPENGLES2)
+      
+      // start an asynchronous read into the pixel buffer
+      glBindFramebuffer( GL_READ_FRAMEBUFFER, FramebufferID );
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, PixelBufferIDs[ Slot ] );
+      glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+      glReadPixels( 0, 0, Constants::ScreenWidth, Constants::ScreenHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+      glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    
+    #endif
+    
+    SlotContents[ Slot ] = CaptureSlotContents::RenderedFrame;
+    memcpy( SlotSamples[ Slot ], Audio.Samples, sizeof( SlotSamples[ Slot ] ) );
+    CapturedFrames++;
+    
+    // measure the time taken from emulation
+    double Milliseconds = chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+    TotalOverheadMilliseconds += Milliseconds;
+    MaximumOverheadMilliseconds = max( MaximumOverheadMilliseconds, Milliseconds );
+}
+
+// -----------------------------------------------------------------------------
+
+void CaptureOutput::CaptureSkippedFrame( const SPUOutputBuffer& Audio )
+{
+    if( !IsCapturing )
+      return;
+    
+    auto StartTime = chrono::steady_clock::now();
+    unsigned Slot = AcquireSlot();
+    
+    SlotContents[ Slot ] = CaptureSlotContents::SkippedFrame;
+    memcpy( SlotSamples[ Slot ], Audio.Samples, sizeof( SlotSamples[ Slot ] ) );
+    CapturedFrames++;
+    
+    double Milliseconds = chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+    TotalOverheadMilliseconds += Milliseconds;
+    MaximumOverheadMilliseconds = max( MaximumOverheadMilliseconds, Milliseconds );
+}
+
+
+// =============================================================================
+//      CAPTURE OUTPUT: WRITER THREAD SIDE
+// =============================================================================
+
+
+void CaptureOutput::WriterLoop()
+{
+    while( true )
+    {
+        CaptureFrame* Frame = nullptr;
+        
+        // wait until there is work to do
+        {
+            unique_lock< mutex > Lock( QueueMutex );
+            QueueCondition.wait( Lock, [this]{ return StopRequested || !QueuedFrames.empty(); } );
+            
+            // when stopping, first finish all queued frames
+            if( QueuedFrames.empty() )
+              return;
+            
+            Frame = QueuedFrames.front();
+            QueuedFrames.pop_front();
+        }
+        
+        // write the frame without holding the lock
+        if( !Frame->RepeatPreviousFrame )
+          memcpy( LastPixels.data(), Frame->Pixels.data(), CaptureFrameBytes );
+        
+        WriteVideoFrame( LastPixels.data() );
+        WriteAudioFrame( Frame->Samples );
+        
+        // return the frame to the pool
+        {
+            lock_guard< mutex > Lock( QueueMutex );
+            FreeFrames.push_back( Frame );
+            WrittenFrames++;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// converts RGBA to 4:4:4 YCbCr (BT.601, limited range)
+void CaptureOutput::WriteVideoFrame( const uint8_t* Pixels )
+{
+    const int Width = Constants::ScreenWidth;
+    const int Height = Constants::ScreenHeight;
+    
+    PlaneY.resize( Width * Height );
+    PlaneU.resize( Width * Height );
+    PlaneV.resize( Width * Height );
+    
+    for( int y = 0; y < Height; y++ )
+    {
+        // framebuffer rows are stored bottom to top
+        const uint8_t* Row = Pixels + (Height - 1 - y) * Width * 4;
+        int Offset = y * Width;
+        
+        for( int x = 0; x < Width; x++ )
+        {
+            int R = Row[ 4*x + 0 ];
+            int G = Row[ 4*x + 1 ];
+            int B = Row[ 4*x + 2 ];
+            
+            PlaneY[ Offset + x ] = (uint8_t)((( 66 * R + 129 * G +  25 * B + 128) >> 8) +  16);
+            PlaneU[ Offset + x ] = (uint8_t)(((-38 * R -  74 * G + 112 * B + 128) >> 8) + 128);
+            PlaneV[ Offset + x ] = (uint8_t)(((112 * R -  94 * G -  18 * B + 128) >> 8) + 128);
+        }
+    }
+    
+    fputs( "FRAME\n", VideoFile );
+    fwrite( PlaneY.data(), 1, PlaneY.size(), VideoFile );
+    fwrite( PlaneU.data(), 1, PlaneU.size(), VideoFile );
+    fwrite( PlaneV.data(), 1, PlaneV.size(), VideoFile );
+}
+
+// -----------------------------------------------------------------------------
+
+void CaptureOutput::WriteAudioFrame( const SPUSample* Samples )
+{
+    // WAV samples are little endian, as are our target platforms
+    fwrite( Samples, sizeof( SPUSample ), Constants::SPUSamplesPerFrame, AudioFile );
+    WrittenAudioBytes += Constants::SPUSamplesPerFrame * sizeof( SPUSample );
+}
+
+// -----------------------------------------------------------------------------
+
+void CaptureOutput::WriteWAVHeader()
+{
+    // PCM, 16-bit stereo at the SPU sampling rate
+    uint32_t SampleRate = Constants::SPUSamplingRate;
+    uint32_t ByteRate = SampleRate * 4;
+    uint32_t RIFFSize = 36 + WrittenAudioBytes;
+    uint32_t FormatSize = 16;
+    uint16_t FormatPCM = 1;
+    uint16_t Channels = 2;
+    uint16_t BlockAlign = 4;
+    uint16_t BitsPerSample = 16;
+    
+    fseek( AudioFile, 0, SEEK_SET );
+    fwrite( "RIFF", 1, 4, AudioFile );
+    fwrite( &RIFFSize, 4, 1, AudioFile );
+    fwrite( "WAVEfmt ", 1, 8, AudioFile );
+    fwrite( &FormatSize, 4, 1, AudioFile );
+    fwrite( &FormatPCM, 2, 1, AudioFile );
+    fwrite( &Channels, 2, 1, AudioFile );
+    fwrite( &SampleRate, 4, 1, AudioFile );
+    fwrite( &ByteRate, 4, 1, AudioFile );
+    fwrite( &BlockAlign, 2, 1, AudioFile );
+    fwrite( &BitsPerSample, 2, 1, AudioFile );
+    fwrite( "data", 1, 4, AudioFile );
+    fwrite( &WrittenAudioBytes, 4, 1, AudioFile );
+    fseek( AudioFile, 0, SEEK_END );
+}
+
+
+// =============================================================================
+//      CAPTURE OUTPUT: METRICS
+// =============================================================================
+
+
+CaptureStatistics CaptureOutput::GetStatistics()
+{
+    CaptureStatistics Statistics;
+    Statistics.CapturedFrames = CapturedFrames;
+    Statistics.DroppedFrames = DroppedFrames;
+    Statistics.MaximumOverheadMilliseconds = MaximumOverheadMilliseconds;
+    Statistics.AverageOverheadMilliseconds = CapturedFrames? (TotalOverheadMilliseconds / CapturedFrames) : 0;
+    
+    {
+        lock_guard< mutex > Lock( QueueMutex );
+        Statistics.WrittenFrames = WrittenFrames;
+    }
+    
+    return Statistics;
+}
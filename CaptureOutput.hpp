@@ -0,0 +1,164 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef CAPTUREOUTPUT_HPP
+    #define CAPTUREOUTPUT_HPP
+    
+    // include common Vircon headers
+    #include "VirconDefinitions/DataStructures.hpp"
+    #include "VirconDefinitions/Constants.hpp"
+    
+    // include console logic headers
+    #include "ConsoleLogic/ExternalInterfaces.hpp"
+    
+    // include OpenGL headers
+    #include "glsym/glsym.h"
+    
+    // include C/C++ headers
+    #include <string>               // [ C++ STL ] Strings
+    #include <vector>               // [ C++ STL ] Vectors
+    #include <list>                 // [ C++ STL ] Lists
+    #include <thread>               // [ C++ STL ] Threads
+    #include <mutex>                // [ C++ STL ] Mutexes
+    #include <condition_variable>   // [ C++ STL ] Condition variables
+    #include <stdio.h>              // [ ANSI C ] Standard I/O
+    #include <stdint.h>             // [ ANSI C ] Standard integer types
+// *****************************************************************************
+
+
+// pixel buffers used for asynchronous framebuffer reads;
+// each frame is mapped this many frames after being read
+#define CAPTURE_PIXEL_BUFFERS 3
+
+// maximum frames waiting to be written to disk
+// (each one takes 900 KB for video plus the audio)
+#define CAPTURE_QUEUE_SIZE 16
+
+
+// =============================================================================
+//      CAPTURE DATA STRUCTURES
+// =============================================================================
+
+
+// what each pixel buffer slot is holding
+enum class CaptureSlotContents
+{
+    Empty = 0,
+    RenderedFrame,      // pixels are being read into the buffer
+    SkippedFrame        // no pixels, only audio
+};
+
+// -----------------------------------------------------------------------------
+
+// one frame waiting to be written to disk
+typedef struct
+{
+    // pixels as read from the framebuffer: RGBA, bottom row first
+    std::vector< uint8_t > Pixels;
+    
+    // for frames not rendered (such as skipped ones)
+    // the previous video frame is written again
+    bool RepeatPreviousFrame;
+    
+    // audio generated during this frame
+    V32::SPUSample Samples[ V32::Constants::SPUSamplesPerFrame ];
+}
+CaptureFrame;
+
+// -----------------------------------------------------------------------------
+
+typedef struct
+{
+    unsigned CapturedFrames;
+    unsigned WrittenFrames;
+    unsigned DroppedFrames;
+    
+    // time spent by the emulation thread on capture
+    double AverageOverheadMilliseconds;
+    double MaximumOverheadMilliseconds;
+}
+CaptureStatistics;
+
+
+// =============================================================================
+//      ASYNCHRONOUS AUDIO AND VIDEO CAPTURE
+// =============================================================================
+
+
+// frames are read from the GPU with pixel buffer objects
+// and queued from the emulation thread; a writer thread
+// converts and writes them to a Y4M file and a WAV file
+class CaptureOutput
+{
+    private:
+        
+        // state
+        bool IsCapturing;
+        
+        // output files
+        FILE* VideoFile;
+        FILE* AudioFile;
+        uint32_t WrittenAudioBytes;
+        
+        // GPU read back: slots are used in a cycle and a frame
+        // is only queued (along with its audio) when its slot
+        // is needed again, so that frames keep their order
+        GLuint PixelBufferIDs[ CAPTURE_PIXEL_BUFFERS ];
+        CaptureSlotContents SlotContents[ CAPTURE_PIXEL_BUFFERS ];
+        V32::SPUSample SlotSamples[ CAPTURE_PIXEL_BUFFERS ][ V32::Constants::SPUSamplesPerFrame ];
+        unsigned NextSlot;
+        
+        // frame queue, protected by the mutex; frames are
+        // never allocated after start, only moved between
+        // the list of free frames and the list of queued ones
+        std::list< CaptureFrame* > FreeFrames;
+        std::list< CaptureFrame* > QueuedFrames;
+        std::vector< CaptureFrame > FramePool;
+        std::mutex QueueMutex;
+        std::condition_variable QueueCondition;
+        bool StopRequested;
+        
+        // writer thread and its working buffers
+        std::thread WriterThread;
+        std::vector< uint8_t > PlaneY, PlaneU, PlaneV;
+        std::vector< uint8_t > LastPixels;
+        
+        // metrics
+        unsigned CapturedFrames;
+        unsigned WrittenFrames;
+        unsigned DroppedFrames;
+        double TotalOverheadMilliseconds;
+        double MaximumOverheadMilliseconds;
+        
+        // internal operations
+        unsigned AcquireSlot();
+        void ResolveSlot( unsigned Slot );
+        void QueueFrame( const uint8_t* Pixels, const V32::SPUSample* Samples );
+        void WriterLoop();
+        void WriteVideoFrame( const uint8_t* Pixels );
+        void WriteAudioFrame( const V32::SPUSample* Samples );
+        void WriteWAVHeader();
+        
+    public:
+        
+        // instance handling
+        CaptureOutput();
+       ~CaptureOutput();
+        
+        // capture control
+        bool Start( const std::string& BasePath );
+        void Stop();
+        bool IsActive();
+        
+        // to be called once per frame after it has been rendered
+        void CaptureRenderedFrame( GLuint FramebufferID, const V32::SPUOutputBuffer& Audio );
+        void CaptureSkippedFrame( const V32::SPUOutputBuffer& Audio );
+        
+        // metrics
+        CaptureStatistics GetStatistics();
+};
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
@@ -2,6 +2,10 @@
     // include console logic headers
     #include "AuxiliaryFunctions.hpp"
     
+    // include C/C++ headers
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <vector>           // [ C++ STL ] Vectors
+    
     // declare used namespaces
     using namespace std;
 // *****************************************************************************
@@ -57,4 +61,55 @@ namespace V32
         
         return true;
     }
+    
+    
+    // =============================================================================
+    //      DATA HASHING FUNCTIONS
+    // =============================================================================
+    
+    
+    // not a cryptographic hash: it is only used to find
+    // candidate duplicates, which are then fully compared
+    uint64_t HashData( const void* Data, size_t Size )
+    {
+        const uint8_t* Bytes = (const uint8_t*)Data;
+        uint64_t Hash = 0xCBF29CE484222325ULL ^ Size;
+        
+        for( size_t i = 0; i < Size; i += 8 )
+        {
+            uint64_t Word = 0;
+            memcpy( &Word, Bytes + i, (Size - i < 8)? (Size - i) : 8 );
+            
+            Hash = (Hash ^ Word) * 0x9E3779B97F4A7C15ULL;
+            Hash ^= Hash >> 32;
+        }
+        
+        return Hash;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // compares data with the file contents at the given
+    // position; the current file position is preserved
+    bool FileDataMatches( ifstream& InputFile, streampos Position, const void* Data, size_t Size )
+    {
+        const size_t ChunkSize = 65536;
+        vector< char > Chunk( ChunkSize );
+        const char* Bytes = (const char*)Data;
+        
+        streampos PreviousPosition = InputFile.tellg();
+        InputFile.seekg( Position );
+        bool Matches = true;
+        
+        for( size_t i = 0; i < Size && Matches; i += ChunkSize )
+        {
+            size_t ReadSize = (Size - i < ChunkSize)? (Size - i) : ChunkSize;
+            InputFile.read( &Chunk[ 0 ], ReadSize );
+            Matches = !InputFile.fail() && !memcmp( &Chunk[ 0 ], Bytes + i, ReadSize );
+        }
+        
+        InputFile.clear();
+        InputFile.seekg( PreviousPosition );
+        return Matches;
+    }
 }
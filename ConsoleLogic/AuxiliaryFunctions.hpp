@@ -7,6 +7,7 @@
     #include <string>           // [ C++ STL ] Strings
     #include <iostream>         // [ C++ STL ] I/O Streams
     #include <fstream>          // [ C++ STL ] File streams
+    #include <cstdint>          // [ C++ STL ] Standard integer types
 // *****************************************************************************
 
 
@@ -30,6 +31,15 @@ namespace V32
     bool CheckSignature( char* Signature, const char* Expected );
     
     
+    // =============================================================================
+    //      DATA HASHING FUNCTIONS
+    // =============================================================================
+    
+    
+    uint64_t HashData( const void* Data, size_t Size );
+    bool FileDataMatches( std::ifstream& InputFile, std::streampos Position, const void* Data, size_t Size );
+    
+    
     // =============================================================================
     //      NUMERIC FUNCTIONS
     // =============================================================================
@@ -29,10 +29,19 @@ namespace V32
         void( *SetMultiplyColor )( V32::GPUColor ) = nullptr;
         void( *SetBlendingMode )( int ) = nullptr;
         void( *SelectTexture )( int ) = nullptr;
-        void( *LoadTexture )( int, void* ) = nullptr;
+        void( *LoadTexture )( int, void*, int, int ) = nullptr;
         void( *UnloadCartridgeTextures )() = nullptr;
         void( *UnloadBiosTexture )() = nullptr;
         
+        // optional: called before loading cartridge textures
+        void( *ReserveCartridgeTextures )( int ) = nullptr;
+        
+        // optional: reuses a previous texture with the same pixels
+        bool( *ShareTexture )( int, int ) = nullptr;
+        
+        // optional: replaces DrawQuad for region drawings
+        void( *DrawRegion )( const V32::GPURegionDrawing& ) = nullptr;
+        
         // callbacks to the log library
         void( *LogLine )( const string& ) = nullptr;
         void( *ThrowException )( const string& ) = nullptr;
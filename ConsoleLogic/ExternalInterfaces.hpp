@@ -72,6 +72,23 @@ namespace V32
     }
     GPUQuad;
     
+    // -----------------------------------------------------------------------------
+    
+    // parameters of a region drawing, given before any
+    // transforms; when scaling or rotation are not used
+    // they are given as neutral values (scale 1, angle 0)
+    typedef struct
+    {
+        int32_t RegionID;
+        int32_t MinX, MinY;
+        int32_t MaxX, MaxY;
+        int32_t HotspotX, HotspotY;
+        int32_t DrawingPointX, DrawingPointY;
+        float DrawingScaleX, DrawingScaleY;
+        float DrawingAngle;
+    }
+    GPURegionDrawing;
+    
     
     // =============================================================================
     //      CALLBACKS FOR EXTERNAL FUNCTIONS
@@ -82,16 +99,32 @@ namespace V32
     // the console will invoke them without any checks
     namespace Callbacks
     {
-        // callbacks to the video library
+        // callbacks to the video library (textures are
+        // loaded at their real size, as width x height
+        // RGBA pixels without any padding)
         extern void( *ClearScreen )( V32::GPUColor );
         extern void( *DrawQuad )( V32::GPUQuad& );
         extern void( *SetMultiplyColor )( V32::GPUColor );
         extern void( *SetBlendingMode )( int );
         extern void( *SelectTexture )( int );
-        extern void( *LoadTexture )( int, void* );
+        extern void( *LoadTexture )( int, void*, int, int );
         extern void( *UnloadCartridgeTextures )();
         extern void( *UnloadBiosTexture )();
         
+        // optional: called before loading cartridge textures
+        extern void( *ReserveCartridgeTextures )( int );
+        
+        // optional: called instead of LoadTexture when a cartridge
+        // texture has the same pixels as a previous one, so that
+        // it can be reused; when this returns false, the texture
+        // is loaded anyway
+        extern bool( *ShareTexture )( int, int );
+        
+        // optional: when provided, regions are drawn with
+        // this instead of DrawQuad, and the video library
+        // has to apply all region transforms by itself
+        extern void( *DrawRegion )( const V32::GPURegionDrawing& );
+        
         // callbacks to the log library
         extern void( *LogLine )( const std::string& );
         extern void( *ThrowException )( const std::string& );
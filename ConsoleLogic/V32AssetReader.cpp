@@ -0,0 +1,227 @@
+// *****************************************************************************
+    // include console logic headers
+    #include "V32AssetReader.hpp"
+    #include "ExternalInterfaces.hpp"
+    #include "AuxiliaryFunctions.hpp"
+    
+    // include C/C++ headers
+    #include <fstream>          // [ C++ STL ] File streams
+    #include <chrono>           // [ C++ STL ] Time measurement
+    
+    // declare used namespaces
+    using namespace std;
+// *****************************************************************************
+
+
+namespace V32
+{
+    // =============================================================================
+    //      CLASS: V32 ASSET READER
+    // =============================================================================
+    
+    
+    V32AssetReader::V32AssetReader()
+    {
+        NextAsset = 0;
+        ReleasedAssets = 0;
+        NumberOfThreads = 0;
+        ReadAhead = 0;
+        StopRequested = false;
+        ReadMilliseconds = 0;
+        WaitMilliseconds = 0;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // (this also stops the workers when loading fails)
+    V32AssetReader::~V32AssetReader()
+    {
+        Stop();
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void V32AssetReader::Start( const string& FilePathUTF8, const vector< AssetLocation >& AssetList, unsigned Threads )
+    {
+        Stop();
+        
+        FilePath = FilePathUTF8;
+        Assets = AssetList;
+        AssetData.clear();
+        AssetData.resize( Assets.size() );
+        AssetHashes.assign( Assets.size(), 0 );
+        States.assign( Assets.size(), AssetStates::Pending );
+        
+        NextAsset = 0;
+        ReleasedAssets = 0;
+        StopRequested = false;
+        ReadMilliseconds = 0;
+        WaitMilliseconds = 0;
+        
+        // no more threads than assets to read
+        if( Threads > Assets.size() )
+          Threads = Assets.size();
+        
+        // each thread can be reading 2 assets ahead
+        NumberOfThreads = Threads;
+        ReadAhead = 2 * Threads;
+        
+        for( unsigned i = 0; i < Threads; i++ )
+          Workers.push_back( thread( &V32AssetReader::WorkerLoop, this ) );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void V32AssetReader::Stop()
+    {
+        {
+            lock_guard< mutex > Lock( AssetMutex );
+            StopRequested = true;
+        }
+        
+        AssetCondition.notify_all();
+        
+        for( thread& Worker: Workers )
+          Worker.join();
+        
+        Workers.clear();
+        AssetData.clear();
+        FreeBuffers.clear();
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void V32AssetReader::WorkerLoop()
+    {
+        // positions are independent for each thread
+        ifstream InputFile;
+        OpenInputFile( InputFile, FilePath, ios_base::binary );
+        
+        while( true )
+        {
+            unsigned Index;
+            AssetBuffer Buffer;
+            Buffer.Capacity = 0;
+            
+            // wait until the next asset can be read
+            {
+                unique_lock< mutex > Lock( AssetMutex );
+                
+                AssetCondition.wait( Lock, [&]
+                {
+                    return StopRequested || NextAsset >= Assets.size() || NextAsset < ReleasedAssets + ReadAhead;
+                });
+                
+                if( StopRequested || NextAsset >= Assets.size() )
+                  return;
+                
+                Index = NextAsset++;
+                
+                for( unsigned i = 0; i < FreeBuffers.size(); i++ )
+                  if( FreeBuffers[ i ].Capacity >= (size_t)Assets[ Index ].Width * Assets[ Index ].Height * 4 )
+                  {
+                      Buffer = move( FreeBuffers[ i ] );
+                      FreeBuffers.erase( FreeBuffers.begin() + i );
+                      break;
+                  }
+            }
+            
+            auto StartTime = chrono::steady_clock::now();
+            
+            // read all data at once, and hash it here
+            // too so that it is done in parallel
+            const AssetLocation& Asset = Assets[ Index ];
+            size_t Bytes = (size_t)Asset.Width * Asset.Height * 4;
+            
+            if( Buffer.Capacity < Bytes )
+            {
+                Buffer.Bytes.reset( new uint8_t[ Bytes ] );
+                Buffer.Capacity = Bytes;
+            }
+            
+            InputFile.seekg( (streamoff)Asset.FilePosition, ios_base::beg );
+            InputFile.read( (char*)Buffer.Bytes.get(), Bytes );
+            
+            bool Failed = InputFile.fail();
+            uint64_t Hash = (Failed? 0 : HashData( Buffer.Bytes.get(), Bytes ));
+            double Milliseconds = chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+            
+            // report the asset as read
+            {
+                lock_guard< mutex > Lock( AssetMutex );
+                AssetData[ Index ] = move( Buffer );
+                AssetHashes[ Index ] = Hash;
+                States[ Index ] = (Failed? AssetStates::Failed : AssetStates::Ready);
+                ReadMilliseconds += Milliseconds;
+            }
+            
+            AssetCondition.notify_all();
+        }
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // the returned data is valid until the asset is released
+    const void* V32AssetReader::WaitForAsset( unsigned Index, uint64_t& Hash )
+    {
+        unique_lock< mutex > Lock( AssetMutex );
+        
+        if( States[ Index ] == AssetStates::Pending )
+        {
+            auto StartTime = chrono::steady_clock::now();
+            AssetCondition.wait( Lock, [&]{ return States[ Index ] != AssetStates::Pending; } );
+            WaitMilliseconds += chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+        }
+        
+        if( States[ Index ] == AssetStates::Failed )
+          return nullptr;
+        
+        Hash = AssetHashes[ Index ];
+        return AssetData[ Index ].Bytes.get();
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // the asset's buffer is kept for reuse (only as many
+    // as can be read ahead), and workers can read further
+    void V32AssetReader::ReleaseAsset( unsigned Index )
+    {
+        {
+            lock_guard< mutex > Lock( AssetMutex );
+            
+            if( FreeBuffers.size() < ReadAhead )
+              FreeBuffers.push_back( move( AssetData[ Index ] ) );
+            
+            AssetData[ Index ].Bytes.reset();
+            AssetData[ Index ].Capacity = 0;
+            ReleasedAssets = Index + 1;
+        }
+        
+        AssetCondition.notify_all();
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    unsigned V32AssetReader::GetNumberOfThreads()
+    {
+        return NumberOfThreads;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // this is the sum for all threads
+    double V32AssetReader::GetReadMilliseconds()
+    {
+        lock_guard< mutex > Lock( AssetMutex );
+        return ReadMilliseconds;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // time the caller was blocked by WaitForAsset
+    double V32AssetReader::GetWaitMilliseconds()
+    {
+        lock_guard< mutex > Lock( AssetMutex );
+        return WaitMilliseconds;
+    }
+}
@@ -0,0 +1,119 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef V32ASSETREADER_HPP
+    #define V32ASSETREADER_HPP
+    
+    // include C/C++ headers
+    #include <string>               // [ C++ STL ] Strings
+    #include <vector>               // [ C++ STL ] Vectors
+    #include <thread>               // [ C++ STL ] Threads
+    #include <mutex>                // [ C++ STL ] Mutexes
+    #include <condition_variable>   // [ C++ STL ] Condition variables
+    #include <memory>               // [ C++ STL ] Smart pointers
+    #include <stdint.h>             // [ ANSI C ] Standard integer types
+// *****************************************************************************
+
+
+namespace V32
+{
+    // =============================================================================
+    //      ASSET READER DEFINITIONS
+    // =============================================================================
+    
+    
+    // where the data of a cartridge asset is stored in the file
+    // (a sound is taken as its samples x 1 pixels of 4 bytes)
+    typedef struct
+    {
+        uint64_t FilePosition;
+        uint32_t Width, Height;
+    }
+    AssetLocation;
+    
+    // -----------------------------------------------------------------------------
+    
+    // data is not initialized before reading, and buffers
+    // are reused for later assets when they are large enough
+    typedef struct
+    {
+        std::unique_ptr< uint8_t[] > Bytes;
+        size_t Capacity;
+    }
+    AssetBuffer;
+    
+    // -----------------------------------------------------------------------------
+    
+    enum class AssetStates
+    {
+        Pending = 0,
+        Ready,
+        Failed
+    };
+    
+    
+    // =============================================================================
+    //      V32 ASSET READER
+    // =============================================================================
+    
+    
+    // reads the data of a list of assets from a file using
+    // several worker threads, each with its own file stream;
+    // assets are taken in order, and only a few of them are
+    // read ahead of the one being used to limit memory usage
+    class V32AssetReader
+    {
+        private:
+            
+            std::string FilePath;
+            std::vector< AssetLocation > Assets;
+            
+            // data and hash of each asset, when read
+            std::vector< AssetBuffer > AssetData;
+            std::vector< uint64_t > AssetHashes;
+            std::vector< AssetStates > States;
+            std::vector< AssetBuffer > FreeBuffers;
+            
+            // worker thread control
+            std::vector< std::thread > Workers;
+            std::mutex AssetMutex;
+            std::condition_variable AssetCondition;
+            unsigned NextAsset;
+            unsigned ReleasedAssets;
+            unsigned NumberOfThreads;
+            unsigned ReadAhead;
+            bool StopRequested;
+            
+            // metrics
+            double ReadMilliseconds;
+            double WaitMilliseconds;
+            
+            // internal operations
+            void WorkerLoop();
+            
+        public:
+            
+            // instance handling
+            V32AssetReader();
+           ~V32AssetReader();
+            
+            // thread handling
+            void Start( const std::string& FilePathUTF8, const std::vector< AssetLocation >& AssetList, unsigned Threads );
+            void Stop();
+            
+            // assets have to be waited for and released in
+            // order; on read errors, nullptr is returned
+            const void* WaitForAsset( unsigned Index, uint64_t& Hash );
+            void ReleaseAsset( unsigned Index );
+            
+            // metrics
+            unsigned GetNumberOfThreads();
+            double GetReadMilliseconds();
+            double GetWaitMilliseconds();
+    };
+}
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
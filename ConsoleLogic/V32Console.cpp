@@ -7,9 +7,12 @@
     #include "V32Console.hpp"
     #include "ExternalInterfaces.hpp"
     #include "AuxiliaryFunctions.hpp"
+    #include "V32AssetReader.hpp"
     
     // include C/C++ headers
     #include <cstring>          // [ ANSI C ] Strings
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    #include <chrono>           // [ C++ STL ] Time measurement
     
     // declare used namespaces
     using namespace std;
@@ -19,7 +22,46 @@
 namespace V32
 {
     // buffer used to transmit textures from loaded ROM files to the video library
-    static GPUColor LoadedTexture[ Constants::GPUTextureSize ][ Constants::GPUTextureSize ];
+    // (only the first width x height pixels are used, with no padding)
+    static GPUColor LoadedTexture[ Constants::GPUTextureSize * Constants::GPUTextureSize ];
+    
+    
+    // =============================================================================
+    //      DETECTION OF DUPLICATE ASSETS
+    // =============================================================================
+    
+    
+    // information kept for each loaded cartridge asset,
+    // so that later ones with the same contents are found
+    // (a sound is taken as its samples x 1 pixels of 4 bytes)
+    typedef struct
+    {
+        uint64_t Hash;
+        uint32_t Width, Height;
+        streampos FilePosition;
+    }
+    LoadedAssetInfo;
+    
+    // -----------------------------------------------------------------------------
+    
+    // returns the ID of the first previous asset with the same
+    // contents, or -1 if there is none; candidates with the same
+    // hash are compared with the data stored in the file
+    static int FindIdenticalAsset( ifstream& InputFile, const vector< LoadedAssetInfo >& PreviousAssets, const LoadedAssetInfo& Asset, const void* Data )
+    {
+        for( unsigned i = 0; i < PreviousAssets.size(); i++ )
+        {
+            const LoadedAssetInfo& Previous = PreviousAssets[ i ];
+            
+            if( Previous.Hash != Asset.Hash || Previous.Width != Asset.Width || Previous.Height != Asset.Height )
+              continue;
+            
+            if( FileDataMatches( InputFile, Previous.FilePosition, Data, Asset.Width * Asset.Height * 4 ) )
+              return i;
+        }
+        
+        return -1;
+    }
     
     
     // =============================================================================
@@ -381,16 +423,12 @@ namespace V32
         ||  !IsBetween( TextureHeader.TextureHeight, 1, Constants::GPUTextureSize ) )
           Callbacks::ThrowException( "BIOS texture does not have correct dimensions (from 1x1 up to 1024x1024 pixels)" );
         
-        // clear all texture pixels
-        memset( LoadedTexture, 0, sizeof(LoadedTexture) );
-        
-        // load the texture pixels line by line,
-        // in order to expand it to full size
-        for( unsigned y = 0; y < TextureHeader.TextureHeight; y++ )
-          Input.read( (char*)(LoadedTexture[ y ]), TextureHeader.TextureWidth * 4 );
+        // load all texture pixels at once, since the
+        // video library takes them at their real size
+        Input.read( (char*)LoadedTexture, TextureHeader.TextureWidth * TextureHeader.TextureHeight * 4 );
         
         // send bios texture to the video library
-        Callbacks::LoadTexture( -1, LoadedTexture );
+        Callbacks::LoadTexture( -1, LoadedTexture, TextureHeader.TextureWidth, TextureHeader.TextureHeight );
         
         // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
         // STEP 5: Load audio rom
@@ -472,6 +510,7 @@ namespace V32
     
         // unload any previous cartridge
         UnloadCartridge();
+        auto StartTime = chrono::steady_clock::now();
         
         // open cartridge file
         ifstream InputFile;
@@ -575,26 +614,47 @@ namespace V32
         if( !IsBetween( BinaryHeader.NumberOfWords, 1, Constants::MaximumCartridgeProgramROM ) )
           Callbacks::ThrowException( "Cartridge program ROM does not have a correct size (from 1 word up to 128M words)" );
         
-        // load the binary contents
-        vector< V32Word > LoadedBinary;
-        LoadedBinary.resize( BinaryHeader.NumberOfWords );
-        InputFile.read( (char*)(&LoadedBinary[ 0 ]), BinaryHeader.NumberOfWords * 4 );
-        CartridgeController.Connect( &LoadedBinary[ 0 ], BinaryHeader.NumberOfWords );
+        // when possible, use the binary contents directly from
+        // the file instead of loading them into memory
+        uint64_t BinaryOffset = ROMHeader.ProgramROMLocation.StartOffset + sizeof(BinaryFileFormat::Header);
         
-        // discard the temporary buffer
-        LoadedBinary.clear();
+        if( CartridgeController.ConnectMappedFile( FilePath, BinaryOffset, BinaryHeader.NumberOfWords ) )
+        {
+            Callbacks::LogLine( "-> Program ROM is mapped from the file" );
+            InputFile.seekg( BinaryHeader.NumberOfWords * 4, ios_base::cur );
+        }
+        
+        // otherwise load the binary contents
+        else
+        {
+            vector< V32Word > LoadedBinary;
+            LoadedBinary.resize( BinaryHeader.NumberOfWords );
+            InputFile.read( (char*)(&LoadedBinary[ 0 ]), BinaryHeader.NumberOfWords * 4 );
+            CartridgeController.Connect( &LoadedBinary[ 0 ], BinaryHeader.NumberOfWords );
+            
+            // discard the temporary buffer
+            LoadedBinary.clear();
+        }
+        
+        auto ProgramROMTime = chrono::steady_clock::now();
         
         // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-        // STEP 4: Load video rom
+        // STEP 4: Index video and audio roms
         // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
         
-        Callbacks::LogLine( "Loading cartridge video ROM" );
+        Callbacks::LogLine( "Indexing cartridge video and audio ROMs" );
+        
+        // check the headers of all textures and sounds, and find
+        // where their data is; the data itself is then read by
+        // several threads, while the first assets are being loaded
+        vector< AssetLocation > AssetList;
+        uint64_t AssetPosition = InputFile.tellg();
         
-        // load all textures in sequence
         for( unsigned i = 0; i < ROMHeader.NumberOfTextures; i++ )
         {
             // load a texture file signature
             TextureFileFormat::Header TextureHeader;
+            InputFile.seekg( AssetPosition, ios_base::beg );
             InputFile.read( (char*)(&TextureHeader), sizeof(TextureFileFormat::Header) );
             
             // check signature for embedded texture
@@ -610,35 +670,27 @@ namespace V32
             ||  !IsBetween( TextureHeader.TextureHeight, 1, Constants::GPUTextureSize ) )
               Callbacks::ThrowException( "Cartridge texture does not have correct dimensions (1x1 up to 1024x1024 pixels)" );
             
-            // clear all texture pixels
-            memset( LoadedTexture, 0, sizeof(LoadedTexture) );
+            // pixels follow the header
+            AssetLocation Texture;
+            Texture.FilePosition = AssetPosition + sizeof(TextureFileFormat::Header);
+            Texture.Width = TextureHeader.TextureWidth;
+            Texture.Height = TextureHeader.TextureHeight;
+            AssetList.push_back( Texture );
             
-            // load the texture pixels line by line,
-            // in order to expand it to full size
-            for( unsigned y = 0; y < TextureHeader.TextureHeight; y++ )
-              InputFile.read( (char*)(LoadedTexture[ y ]), TextureHeader.TextureWidth * 4 );
+            AssetPosition = Texture.FilePosition + Texture.Width * Texture.Height * 4;
             
-            // send this texture to the video library
-            Callbacks::LoadTexture( i, LoadedTexture );
+            if( AssetPosition > FileBytes )
+              Callbacks::ThrowException( "Incorrect V32 file format (texture data goes past the end of the file)" );
         }
         
-        // now update GPU with the inserted textures
-        GPU.InsertCartridgeTextures( ROMHeader.NumberOfTextures );
-        
-        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-        // STEP 5: Load audio rom
-        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-        
-        Callbacks::LogLine( "Loading cartridge audio ROM" );
-        
         // keep count of the total sound samples
         uint32_t TotalSPUSamples = 0;
         
-        // load all sounds in sequence
         for( unsigned i = 0; i < ROMHeader.NumberOfSounds; i++ )
         {
             // load a sound file signature
             SoundFileFormat::Header SoundHeader;
+            InputFile.seekg( AssetPosition, ios_base::beg );
             InputFile.read( (char*)(&SoundHeader), sizeof(SoundFileFormat::Header) );
             
             // check signature for embedded sound
@@ -659,22 +711,151 @@ namespace V32
             if( TotalSPUSamples > (uint32_t)Constants::SPUMaximumCartridgeSamples )
               Callbacks::ThrowException( "Cartridge sounds contain too many total samples (Vircon SPU only allows up to 256M total samples)" );
             
-            // load the sound samples
-            vector< SPUSample > LoadedSound;
-            LoadedSound.resize( SoundHeader.SoundSamples );
-            InputFile.read( (char*)(&LoadedSound[ 0 ]), SoundHeader.SoundSamples * 4 );
+            // samples follow the header
+            AssetLocation Sound;
+            Sound.FilePosition = AssetPosition + sizeof(SoundFileFormat::Header);
+            Sound.Width = SoundHeader.SoundSamples;
+            Sound.Height = 1;
+            AssetList.push_back( Sound );
             
-            // create a new SPU sound and load data into it
-            SPU.LoadSound( SPU.CartridgeSounds[ i ], &LoadedSound[ 0 ], SoundHeader.SoundSamples );
+            AssetPosition = Sound.FilePosition + Sound.Width * 4;
             
-            // discard the temporary buffer
-            LoadedSound.clear();
+            if( AssetPosition > FileBytes )
+              Callbacks::ThrowException( "Incorrect V32 file format (sound data goes past the end of the file)" );
+        }
+        
+        // use up to 4 threads; more do not help when
+        // reading from a single file in most devices
+        unsigned ReaderThreads = min( max( thread::hardware_concurrency(), 1u ), 4u );
+        
+        V32AssetReader AssetReader;
+        AssetReader.Start( FilePath, AssetList, ReaderThreads );
+        auto IndexTime = chrono::steady_clock::now();
+        
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // STEP 5: Load video rom
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        
+        Callbacks::LogLine( "Loading cartridge video ROM" );
+        
+        // let the video library prepare for all textures
+        if( Callbacks::ReserveCartridgeTextures )
+          Callbacks::ReserveCartridgeTextures( ROMHeader.NumberOfTextures );
+        
+        // textures with the same pixels as a previous
+        // one are shared, if the video library can
+        vector< LoadedAssetInfo > LoadedTextures;
+        unsigned SharedTextures = 0;
+        uint64_t SharedTextureBytes = 0;
+        
+        // load all textures in sequence, as they are read
+        for( unsigned i = 0; i < ROMHeader.NumberOfTextures; i++ )
+        {
+            const AssetLocation& Location = AssetList[ i ];
+            
+            LoadedAssetInfo Texture;
+            Texture.Width = Location.Width;
+            Texture.Height = Location.Height;
+            Texture.FilePosition = Location.FilePosition;
+            
+            const void* Pixels = AssetReader.WaitForAsset( i, Texture.Hash );
+            
+            if( !Pixels )
+              Callbacks::ThrowException( "Cannot read cartridge texture " + to_string( i ) );
+            
+            // reuse a previous copy of these pixels if possible
+            unsigned TextureBytes = Texture.Width * Texture.Height * 4;
+            int SourceTexture = FindIdenticalAsset( InputFile, LoadedTextures, Texture, Pixels );
+            LoadedTextures.push_back( Texture );
+            
+            if( SourceTexture >= 0 && Callbacks::ShareTexture && Callbacks::ShareTexture( i, SourceTexture ) )
+            {
+                Callbacks::LogLine( "-> Texture " + to_string( i ) + " is identical to texture " + to_string( SourceTexture ) );
+                SharedTextures++;
+                SharedTextureBytes += TextureBytes;
+            }
+            
+            // send this texture to the video library
+            else Callbacks::LoadTexture( i, (void*)Pixels, Texture.Width, Texture.Height );
+            
+            AssetReader.ReleaseAsset( i );
+        }
+        
+        // now update GPU with the inserted textures
+        GPU.InsertCartridgeTextures( ROMHeader.NumberOfTextures );
+        auto VideoROMTime = chrono::steady_clock::now();
+        
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // STEP 6: Load audio rom
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        
+        Callbacks::LogLine( "Loading cartridge audio ROM" );
+        
+        // sounds with the same samples as a
+        // previous one are shared in the SPU
+        vector< LoadedAssetInfo > LoadedSounds;
+        unsigned SharedSounds = 0;
+        uint64_t SharedSoundBytes = 0;
+        
+        // load all sounds in sequence, as they are read
+        for( unsigned i = 0; i < ROMHeader.NumberOfSounds; i++ )
+        {
+            unsigned AssetIndex = ROMHeader.NumberOfTextures + i;
+            const AssetLocation& Location = AssetList[ AssetIndex ];
+            
+            LoadedAssetInfo Sound;
+            Sound.Width = Location.Width;
+            Sound.Height = 1;
+            Sound.FilePosition = Location.FilePosition;
+            
+            const void* Samples = AssetReader.WaitForAsset( AssetIndex, Sound.Hash );
+            
+            if( !Samples )
+              Callbacks::ThrowException( "Cannot read cartridge sound " + to_string( i ) );
+            
+            // reuse a previous copy of these samples if possible
+            int SourceSound = FindIdenticalAsset( InputFile, LoadedSounds, Sound, Samples );
+            LoadedSounds.push_back( Sound );
+            
+            if( SourceSound >= 0 )
+            {
+                Callbacks::LogLine( "-> Sound " + to_string( i ) + " is identical to sound " + to_string( SourceSound ) );
+                SPU.ShareSound( SPU.CartridgeSounds[ i ], SPU.CartridgeSounds[ SourceSound ] );
+                SharedSounds++;
+                SharedSoundBytes += Sound.Width * 4;
+            }
+            
+            // otherwise create a new SPU sound and load data into it
+            else SPU.LoadSound( SPU.CartridgeSounds[ i ], (SPUSample*)Samples, Sound.Width );
+            
+            AssetReader.ReleaseAsset( AssetIndex );
         }
         
         SPU.LoadedCartridgeSounds = ROMHeader.NumberOfSounds;
+        AssetReader.Stop();
+        auto AudioROMTime = chrono::steady_clock::now();
+        
+        // report time taken by each step
+        auto Milliseconds = []( chrono::steady_clock::time_point Start, chrono::steady_clock::time_point End )
+        {
+            return chrono::duration< double, milli >( End - Start ).count();
+        };
+        
+        Callbacks::LogLine( "Cartridge load times: program ROM " + to_string( Milliseconds( StartTime, ProgramROMTime ) )
+           + " ms, indexing " + to_string( Milliseconds( ProgramROMTime, IndexTime ) )
+           + " ms, video ROM " + to_string( Milliseconds( IndexTime, VideoROMTime ) )
+           + " ms, audio ROM " + to_string( Milliseconds( VideoROMTime, AudioROMTime ) ) + " ms" );
+        
+        Callbacks::LogLine( "Asset reads: " + to_string( AssetReader.GetReadMilliseconds() ) + " ms in "
+           + to_string( AssetReader.GetNumberOfThreads() ) + " threads, " + to_string( AssetReader.GetWaitMilliseconds() ) + " ms waited for" );
+        
+        // report the savings from duplicate assets
+        if( SharedTextures || SharedSounds )
+          Callbacks::LogLine( "Duplicate assets: " + to_string( SharedTextures ) + " textures and " + to_string( SharedSounds )
+             + " sounds, saving " + to_string( (SharedTextureBytes + SharedSoundBytes) / 1024 ) + " KB" );
         
         // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-        // STEP 5: General Vircon setup
+        // STEP 7: General Vircon setup
         // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
         
         // only when loading was successful:
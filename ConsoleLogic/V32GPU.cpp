@@ -290,6 +290,33 @@ namespace V32
             return;
         }
         
+        // drawings that cannot reach the screen are not
+        // sent to the video library (capacity is still used)
+        if( IsDrawingOffScreen( Region, ScalingEnabled, RotationEnabled ) )
+          return;
+        
+        // when the video library can transform regions
+        // by itself, just give it the drawing parameters
+        if( Callbacks::DrawRegion )
+        {
+            GPURegionDrawing Drawing;
+            Drawing.RegionID = SelectedRegion;
+            Drawing.MinX = Region.MinX;
+            Drawing.MinY = Region.MinY;
+            Drawing.MaxX = Region.MaxX;
+            Drawing.MaxY = Region.MaxY;
+            Drawing.HotspotX = Region.HotspotX;
+            Drawing.HotspotY = Region.HotspotY;
+            Drawing.DrawingPointX = DrawingPointX;
+            Drawing.DrawingPointY = DrawingPointY;
+            Drawing.DrawingScaleX = (ScalingEnabled? DrawingScaleX : 1);
+            Drawing.DrawingScaleY = (ScalingEnabled? DrawingScaleY : 1);
+            Drawing.DrawingAngle = (RotationEnabled? DrawingAngle : 0);
+            
+            Callbacks::DrawRegion( Drawing );
+            return;
+        }
+        
         // calculate absolute texture coordinates
         // (initially, they are pixel-centered and uncorrected)
         float TextureMinX = Region.MinX + 0.5;
@@ -422,4 +449,48 @@ namespace V32
         // draw rectangle defined as a quad (4-vertex polygon)
         Callbacks::DrawQuad( RegionQuad );
     }
+    
+    // -----------------------------------------------------------------------------
+    
+    // this is conservative: for rotations, the drawing is
+    // bounded by the farthest region corner from the hotspot,
+    // and a margin of 1 pixel covers the correction applied
+    // for negative scales (not drawn pixels are never culled)
+    bool V32GPU::IsDrawingOffScreen( const GPURegion& Region, bool ScalingEnabled, bool RotationEnabled )
+    {
+        // region limits relative to the hotspot
+        float RelativeMinX = Region.MinX - Region.HotspotX;
+        float RelativeMinY = Region.MinY - Region.HotspotY;
+        float RelativeMaxX = RelativeMinX + abs(Region.MaxX - Region.MinX) + 1;
+        float RelativeMaxY = RelativeMinY + abs(Region.MaxY - Region.MinY) + 1;
+        
+        if( ScalingEnabled )
+        {
+            RelativeMinX *= DrawingScaleX;
+            RelativeMaxX *= DrawingScaleX;
+            RelativeMinY *= DrawingScaleY;
+            RelativeMaxY *= DrawingScaleY;
+        }
+        
+        float BoundsMinX = min( RelativeMinX, RelativeMaxX );
+        float BoundsMaxX = max( RelativeMinX, RelativeMaxX );
+        float BoundsMinY = min( RelativeMinY, RelativeMaxY );
+        float BoundsMaxY = max( RelativeMinY, RelativeMaxY );
+        
+        if( RotationEnabled )
+        {
+            float MaximumX = max( fabs( BoundsMinX ), fabs( BoundsMaxX ) );
+            float MaximumY = max( fabs( BoundsMinY ), fabs( BoundsMaxY ) );
+            float Radius = sqrt( MaximumX * MaximumX + MaximumY * MaximumY );
+            
+            BoundsMinX = BoundsMinY = -Radius;
+            BoundsMaxX = BoundsMaxY = Radius;
+        }
+        
+        // (written so that NaN values are never culled)
+        return (DrawingPointX + BoundsMaxX + 1 <= 0)
+            || (DrawingPointY + BoundsMaxY + 1 <= 0)
+            || (DrawingPointX + BoundsMinX - 1 >= Constants::ScreenWidth)
+            || (DrawingPointY + BoundsMinY - 1 >= Constants::ScreenHeight);
+    }
 }
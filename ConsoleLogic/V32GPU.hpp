@@ -132,6 +132,7 @@ namespace V32
             // execution of GPU commands
             void ClearScreen();
             void DrawRegion( bool ScalingEnabled, bool RotationEnabled );
+            bool IsDrawingOffScreen( const GPURegion& Region, bool ScalingEnabled, bool RotationEnabled );
     };
     
     
@@ -4,6 +4,16 @@
     
     // include C/C++ headers
     #include <cstring>          // [ ANSI C ] Strings
+    #include <stdint.h>         // [ ANSI C ] Standard integer types
+    
+    // file mapping is only available on POSIX systems
+    #if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__) && !defined(HAVE_LIBNX)
+      #define MAPPED_FILES
+      #include <sys/mman.h>     // [ POSIX ] Memory mapping
+      #include <sys/stat.h>     // [ POSIX ] File status
+      #include <fcntl.h>        // [ POSIX ] File control
+      #include <unistd.h>       // [ POSIX ] Standard symbols
+    #endif
 // *****************************************************************************
 
 
@@ -84,6 +94,16 @@ namespace V32
     V32ROM::V32ROM()
     {
         MemorySize = 0;
+        Words = nullptr;
+        MappedRegion = nullptr;
+        MappedBytes = 0;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    V32ROM::~V32ROM()
+    {
+        Disconnect();
     }
     
     // -----------------------------------------------------------------------------
@@ -99,14 +119,82 @@ namespace V32
         
         // copy the whole address space
         memcpy( &Memory[ 0 ], Source, NumberOfWords * 4 );
+        Words = &Memory[ 0 ];
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    // pages are only read from the file as they are accessed,
+    // and the system can drop them again under memory pressure;
+    // if mapping fails (e.g. not enough address space in 32-bit
+    // hosts for large ROMs) the caller has to use Connect instead
+    bool V32ROM::ConnectMappedFile( const std::string& FilePath, uint64_t FileOffset, uint32_t NumberOfWords )
+    {
+        Disconnect();
+        
+        #if defined(MAPPED_FILES)
+          
+          int FileDescriptor = open( FilePath.c_str(), O_RDONLY );
+          
+          if( FileDescriptor < 0 )
+            return false;
+          
+          // the mapped region has to start at a page boundary
+          uint64_t PageSize = sysconf( _SC_PAGESIZE );
+          uint64_t RegionOffset = FileOffset - (FileOffset % PageSize);
+          uint64_t RegionBytes = (FileOffset - RegionOffset) + (uint64_t)NumberOfWords * 4;
+          
+          // the file must contain the whole ROM, since
+          // reading past its end would crash the process
+          struct stat FileStatus;
+          
+          if( fstat( FileDescriptor, &FileStatus ) != 0
+          ||  (uint64_t)FileStatus.st_size < FileOffset + (uint64_t)NumberOfWords * 4
+          ||  RegionBytes > (uint64_t)SIZE_MAX )
+          {
+              close( FileDescriptor );
+              return false;
+          }
+          
+          void* Region = mmap( nullptr, (size_t)RegionBytes, PROT_READ, MAP_PRIVATE, FileDescriptor, (off_t)RegionOffset );
+          
+          // (the mapping stays valid after closing the file)
+          close( FileDescriptor );
+          
+          if( Region == MAP_FAILED )
+            return false;
+          
+          MappedRegion = Region;
+          MappedBytes = (size_t)RegionBytes;
+          MemorySize = NumberOfWords;
+          Words = (const V32Word*)((const uint8_t*)Region + (FileOffset - RegionOffset));
+          return true;
+        
+        #else
+          
+          (void)FilePath;
+          (void)FileOffset;
+          (void)NumberOfWords;
+          return false;
+        
+        #endif
     }
     
     // -----------------------------------------------------------------------------
     
     void V32ROM::Disconnect()
     {
+        #if defined(MAPPED_FILES)
+          if( MappedRegion )
+            munmap( MappedRegion, MappedBytes );
+        #endif
+        
+        MappedRegion = nullptr;
+        MappedBytes = 0;
+        
         Memory.clear();
         MemorySize = 0;
+        Words = nullptr;
     }
     
     // -----------------------------------------------------------------------------
@@ -118,7 +206,7 @@ namespace V32
           return false;
         
         // provide value
-        Result = Memory[ LocalAddress ];
+        Result = Words[ LocalAddress ];
         return true;
     }
     
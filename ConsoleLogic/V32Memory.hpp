@@ -8,6 +8,7 @@
     
     // include C/C++ headers
     #include <vector>           // [ C++ STL ] Vectors
+    #include <string>           // [ C++ STL ] Strings
 // *****************************************************************************
 
 
@@ -55,16 +56,29 @@ namespace V32
             std::vector< V32Word > Memory;
             int32_t MemorySize;
             
+            // contents are read from here: either the
+            // vector above or a file mapped in memory
+            const V32Word* Words;
+            
+            // mapped file region, if any
+            void* MappedRegion;
+            size_t MappedBytes;
+            
         public:
             
             // instance handling
             V32ROM();
+           ~V32ROM();
             
             // memory connection
             // (unlike RAM, we can only get the contents upon connection)
             void Connect( void* SourceData, uint32_t NumberOfWords );
             void Disconnect();
             
+            // the contents are used directly from the file, without
+            // copying them; returns false if this is not possible
+            bool ConnectMappedFile( const std::string& FilePath, uint64_t FileOffset, uint32_t NumberOfWords );
+            
             // bus connection
             virtual bool ReadAddress( int32_t LocalAddress, V32Word& Result );
             virtual bool WriteAddress( int32_t LocalAddress, V32Word Value );
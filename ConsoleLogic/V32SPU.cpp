@@ -5,6 +5,12 @@
     // include C/C++ headers
     #include <cstring>          // [ ANSI C ] Strings
     #include <cmath>            // [ ANSI C ] Math
+    #include <cstdio>           // [ ANSI C ] Standard I/O
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    #include <chrono>           // [ C++ STL ] Time measurement
+    
+    // declare used namespaces
+    using namespace std;
 // *****************************************************************************
 
 
@@ -39,6 +45,85 @@ namespace V32
     };
     
     
+    // =============================================================================
+    //      IMA ADPCM CODEC FOR COMPRESSED SOUNDS
+    // =============================================================================
+    
+    
+    // quantizer step sizes from the IMA ADPCM standard
+    const int32_t ADPCMStepTable[ 89 ] =
+    {
+            7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+           19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+           50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+          130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+          337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+          876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+         2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+         5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+    
+    // how the step index changes for each coded magnitude
+    const int32_t ADPCMIndexTable[ 8 ] =
+    {
+        -1, -1, -1, -1, 2, 4, 6, 8
+    };
+    
+    // -----------------------------------------------------------------------------
+    
+    // applies a 4-bit code to the decoder state and returns the
+    // new sample; the encoder uses this same function so that
+    // both sides always stay in sync
+    static inline int32_t DecodeADPCMNibble( uint8_t Nibble, int32_t& Predictor, int32_t& StepIndex )
+    {
+        int32_t Step = ADPCMStepTable[ StepIndex ];
+        int32_t Difference = Step >> 3;
+        
+        if( Nibble & 4 ) Difference += Step;
+        if( Nibble & 2 ) Difference += Step >> 1;
+        if( Nibble & 1 ) Difference += Step >> 2;
+        
+        if( Nibble & 8 ) Predictor -= Difference;
+        else             Predictor += Difference;
+        
+        if( Predictor >  32767 ) Predictor =  32767;
+        if( Predictor < -32768 ) Predictor = -32768;
+        
+        StepIndex += ADPCMIndexTable[ Nibble & 7 ];
+        if( StepIndex <  0 ) StepIndex =  0;
+        if( StepIndex > 88 ) StepIndex = 88;
+        
+        return Predictor;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    static inline uint8_t EncodeADPCMSample( int32_t Sample, int32_t& Predictor, int32_t& StepIndex )
+    {
+        int32_t Step = ADPCMStepTable[ StepIndex ];
+        int32_t Difference = Sample - Predictor;
+        uint8_t Nibble = 0;
+        
+        if( Difference < 0 )
+        {
+            Nibble = 8;
+            Difference = -Difference;
+        }
+        
+        // quantize the difference with 3 bits
+        if( Difference >= Step ) { Nibble |= 4; Difference -= Step; }
+        Step >>= 1;
+        if( Difference >= Step ) { Nibble |= 2; Difference -= Step; }
+        Step >>= 1;
+        if( Difference >= Step ) { Nibble |= 1; }
+        
+        // update state exactly as the decoder will
+        DecodeADPCMNibble( Nibble, Predictor, StepIndex );
+        return Nibble;
+    }
+    
+    
     // =============================================================================
     //      V32 SPU: INSTANCE HANDLING
     // =============================================================================
@@ -52,6 +137,18 @@ namespace V32
         
         // no cartridge loaded yet
         LoadedCartridgeSounds = 0;
+        NumberOfActiveChannels = 0;
+        
+        // sounds keep their own samples by default
+        BiosSound.SharedSamples = nullptr;
+        
+        for( int i = 0; i < Constants::SPUMaximumCartridgeSounds; i++ )
+          CartridgeSounds[ i ].SharedSamples = nullptr;
+        
+        // by default keep sounds uncompressed
+        CompressSounds = false;
+        InvalidateDecodeCaches();
+        ResetMixingStatistics();
     }
     
     // -----------------------------------------------------------------------------
@@ -70,9 +167,19 @@ namespace V32
     
     void V32SPU::LoadSound( SPUSound& TargetSound, SPUSample* Samples, unsigned NumberOfSamples )
     {
+        // decoded blocks may belong to the previous contents
+        InvalidateDecodeCaches();
+        TargetSound.SharedSamples = nullptr;
+        
         // copy the buffer to target sound
-        TargetSound.Samples.resize( NumberOfSamples );
-        memcpy( &TargetSound.Samples[ 0 ], Samples, NumberOfSamples * 4 );
+        if( CompressSounds )
+          CompressSound( TargetSound, Samples, NumberOfSamples );
+        
+        else
+        {
+            TargetSound.Samples.resize( NumberOfSamples );
+            memcpy( &TargetSound.Samples[ 0 ], Samples, NumberOfSamples * 4 );
+        }
         
         // update sound length
         TargetSound.Length = NumberOfSamples;
@@ -87,10 +194,109 @@ namespace V32
     
     void V32SPU::UnloadSound( SPUSound& TargetSound )
     {
+        InvalidateDecodeCaches();
+        
         TargetSound.Samples.clear();
+        TargetSound.ADPCMBlocks.clear();
+        TargetSound.ADPCMData.clear();
+        TargetSound.SharedSamples = nullptr;
         TargetSound.Length = 0;
     }
     
+    // -----------------------------------------------------------------------------
+    
+    // the source sound has to stay loaded while the
+    // target is used (both belong to the same cartridge)
+    void V32SPU::ShareSound( SPUSound& TargetSound, const SPUSound& SourceSound )
+    {
+        UnloadSound( TargetSound );
+        TargetSound.SharedSamples = &SourceSound;
+        TargetSound.Length = SourceSound.Length;
+        
+        // loop properties are still independent
+        TargetSound.PlayWithLoop = false;
+        TargetSound.LoopStart = 0;
+        TargetSound.LoopEnd = TargetSound.Length - 1;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void V32SPU::CompressSound( SPUSound& TargetSound, SPUSample* Samples, unsigned NumberOfSamples )
+    {
+        unsigned NumberOfBlocks = (NumberOfSamples + SPUADPCMBlockSamples - 1) / SPUADPCMBlockSamples;
+        
+        TargetSound.Samples.clear();
+        TargetSound.ADPCMBlocks.resize( NumberOfBlocks );
+        TargetSound.ADPCMData.resize( NumberOfSamples );
+        
+        // the step index is kept across blocks, since it adapts
+        // to the signal; but each block restarts from an exact
+        // sample so that errors don't accumulate between blocks
+        int32_t LeftPredictor = 0, RightPredictor = 0;
+        int32_t LeftStepIndex = 0, RightStepIndex = 0;
+        
+        // accumulate error to report compression quality
+        double SignalEnergy = 0, NoiseEnergy = 0;
+        
+        for( unsigned s = 0; s < NumberOfSamples; s++ )
+        {
+            SPUSample Original = Samples[ s ];
+            
+            // at block start, save the exact sample
+            if( (s % SPUADPCMBlockSamples) == 0 )
+            {
+                SPUADPCMBlockHeader& Header = TargetSound.ADPCMBlocks[ s / SPUADPCMBlockSamples ];
+                Header.InitialSample = Original;
+                Header.LeftStepIndex = LeftStepIndex;
+                Header.RightStepIndex = RightStepIndex;
+                Header.Padding = 0;
+                
+                LeftPredictor = Original.LeftSample;
+                RightPredictor = Original.RightSample;
+                
+                // first sample needs no code
+                TargetSound.ADPCMData[ s ] = 0;
+                SignalEnergy += (double)Original.LeftSample * Original.LeftSample;
+                SignalEnergy += (double)Original.RightSample * Original.RightSample;
+                continue;
+            }
+            
+            uint8_t LeftNibble  = EncodeADPCMSample( Original.LeftSample,  LeftPredictor,  LeftStepIndex  );
+            uint8_t RightNibble = EncodeADPCMSample( Original.RightSample, RightPredictor, RightStepIndex );
+            TargetSound.ADPCMData[ s ] = LeftNibble | (RightNibble << 4);
+            
+            // predictors now hold the decoded values
+            double LeftError  = Original.LeftSample  - LeftPredictor;
+            double RightError = Original.RightSample - RightPredictor;
+            SignalEnergy += (double)Original.LeftSample * Original.LeftSample;
+            SignalEnergy += (double)Original.RightSample * Original.RightSample;
+            NoiseEnergy += LeftError * LeftError + RightError * RightError;
+        }
+        
+        // report signal to noise ratio for this sound
+        if( NoiseEnergy <= 0 )
+          Callbacks::LogLine( "   Compressed to ADPCM (lossless)" );
+        
+        else
+        {
+            char SNRText[ 32 ];
+            snprintf( SNRText, sizeof(SNRText), "%.1f", 10.0 * log10( max( SignalEnergy, 1.0 ) / NoiseEnergy ) );
+            Callbacks::LogLine( string("   Compressed to ADPCM (SNR = ") + SNRText + " dB)" );
+        }
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void V32SPU::InvalidateDecodeCaches()
+    {
+        for( SPUDecodeCache& Cache: DecodeCaches )
+        {
+            Cache.Sound = nullptr;
+            Cache.Block = -1;
+            Cache.DecodedSamples = 0;
+        }
+    }
+    
     
     // =============================================================================
     //      V32 SPU: I/O BUS CONNECTION
@@ -190,6 +396,8 @@ namespace V32
             C.Position = 0.0;
         }
         
+        UpdateActiveChannels();
+        
         // reset output buffers
         memset( OutputBuffer.Samples, 0, Constants::SPUSamplesPerFrame * 4 );
         OutputBuffer.SequenceNumber = 0;
@@ -238,6 +446,7 @@ namespace V32
         
         // finally, update channel state
         TargetChannel.State = IOPortValues::SPUChannelState_Playing;
+        UpdateActiveChannels();
     }
     
     // -----------------------------------------------------------------------------
@@ -245,6 +454,7 @@ namespace V32
     void V32SPU::PauseChannel( SPUChannel& TargetChannel )
     {
         TargetChannel.State = IOPortValues::SPUChannelState_Paused;
+        UpdateActiveChannels();
     }
     
     // -----------------------------------------------------------------------------
@@ -256,6 +466,7 @@ namespace V32
         // when stopping, rewind sound
         // (but keep sound and configuration)
         TargetChannel.Position = 0;
+        UpdateActiveChannels();
     }
     
     // -----------------------------------------------------------------------------
@@ -291,6 +502,19 @@ namespace V32
     // =============================================================================
     
     
+    void V32SPU::UpdateActiveChannels()
+    {
+        NumberOfActiveChannels = 0;
+        
+        // keep channel order, so that mixing is done
+        // in the same order as when checking them all
+        for( int c = 0; c < Constants::SPUSoundChannels; c++ )
+          if( Channels[ c ].State == IOPortValues::SPUChannelState_Playing )
+            ActiveChannelIDs[ NumberOfActiveChannels++ ] = c;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
     SPUSound* V32SPU::GetChannelSound( SPUChannel* Channel )
     {
         int32_t ChannelSoundID = Channel->AssignedSound;
@@ -305,21 +529,86 @@ namespace V32
     
     // -----------------------------------------------------------------------------
     
+    SPUSample V32SPU::GetSoundSample( int ChannelID, const SPUSound* Sound, int32_t Position )
+    {
+        if( Sound->SharedSamples )
+          Sound = Sound->SharedSamples;
+        
+        // uncompressed sounds can be read directly
+        if( Sound->ADPCMBlocks.empty() )
+          return Sound->Samples[ Position ];
+        
+        // for compressed sounds, first locate the block
+        SPUDecodeCache& Cache = DecodeCaches[ ChannelID ];
+        int32_t Block = Position / SPUADPCMBlockSamples;
+        int32_t Offset = Position % SPUADPCMBlockSamples;
+        
+        // when entering a different block, restart decoding
+        // from the exact state saved in the block header
+        if( Cache.Sound != Sound || Cache.Block != Block )
+        {
+            const SPUADPCMBlockHeader& Header = Sound->ADPCMBlocks[ Block ];
+            Cache.Sound = Sound;
+            Cache.Block = Block;
+            Cache.Samples[ 0 ] = Header.InitialSample;
+            Cache.LeftPredictor = Header.InitialSample.LeftSample;
+            Cache.RightPredictor = Header.InitialSample.RightSample;
+            Cache.LeftStepIndex = Header.LeftStepIndex;
+            Cache.RightStepIndex = Header.RightStepIndex;
+            Cache.DecodedSamples = 1;
+        }
+        
+        // decode only as far as needed
+        if( Offset >= Cache.DecodedSamples )
+        {
+            const uint8_t* Codes = &Sound->ADPCMData[ Block * SPUADPCMBlockSamples ];
+            
+            for( int32_t s = Cache.DecodedSamples; s <= Offset; s++ )
+            {
+                Cache.Samples[ s ].LeftSample  = DecodeADPCMNibble( Codes[ s ] & 15, Cache.LeftPredictor,  Cache.LeftStepIndex  );
+                Cache.Samples[ s ].RightSample = DecodeADPCMNibble( Codes[ s ] >> 4, Cache.RightPredictor, Cache.RightStepIndex );
+            }
+            
+            MixingStatistics.DecodedSamples += Offset + 1 - Cache.DecodedSamples;
+            Cache.DecodedSamples = Offset + 1;
+        }
+        
+        return Cache.Samples[ Offset ];
+    }
+    
+    // -----------------------------------------------------------------------------
+    
     void V32SPU::UpdateOutputBuffer()
     {
         // assign the next sequence number to the buffer
         OutputBuffer.SequenceNumber++;
         
+        // when no channels are playing the output is silence
+        if( NumberOfActiveChannels == 0 )
+        {
+            memset( OutputBuffer.Samples, 0, Constants::SPUSamplesPerFrame * 4 );
+            return;
+        }
+        
+        // no channel can start playing during this process,
+        // so we only need to consider the ones active now
+        // (local copy, since channels may stop as we mix)
+        auto StartTime = chrono::steady_clock::now();
+        int32_t MixedChannels = NumberOfActiveChannels;
+        int32_t MixedChannelIDs[ Constants::SPUSoundChannels ];
+        memcpy( MixedChannelIDs, ActiveChannelIDs, MixedChannels * sizeof(int32_t) );
+        
         // determine the value for each sample in the buffer
         for( int s = 0; s < Constants::SPUSamplesPerFrame; s++ )
         {
             // use a local variable for speed
             SPUSample ThisSample = {0,0};
             
-            // generate sound for all channels
-            for( int c = 0; c < Constants::SPUSoundChannels; c++ )
+            // generate sound for all active channels
+            for( int i = 0; i < MixedChannels; i++ )
             {
-                // process only playing channels
+                // skip channels that ended during this frame
+                int c = MixedChannelIDs[ i ];
                 SPUChannel* ThisChannel = &Channels[ c ];
                 
                 if( ThisChannel->State != IOPortValues::SPUChannelState_Playing )
@@ -327,7 +616,7 @@ namespace V32
                 
                 // pick sample at this position
                 SPUSound* ChannelSound = GetChannelSound( ThisChannel );
-                SPUSample PickedSample = ChannelSound->Samples[ (int)ThisChannel->Position ];
+                SPUSample PickedSample = GetSoundSample( c, ChannelSound, (int)ThisChannel->Position );
                 
                 // mix the sample
                 float TotalVolume = GlobalVolume * ThisChannel->Volume;
@@ -363,5 +652,27 @@ namespace V32
             
             OutputBuffer.Samples[ s ] = ThisSample;
         }
+        
+        auto EndTime = chrono::steady_clock::now();
+        MixingStatistics.MixedFrames++;
+        MixingStatistics.MixingNanoseconds += chrono::duration_cast< chrono::nanoseconds >( EndTime - StartTime ).count();
+    }
+    
+    
+    // =============================================================================
+    //      V32 SPU: METRICS
+    // =============================================================================
+    
+    
+    SPUMixingStatistics V32SPU::GetMixingStatistics()
+    {
+        return MixingStatistics;
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void V32SPU::ResetMixingStatistics()
+    {
+        memset( &MixingStatistics, 0, sizeof( MixingStatistics ) );
     }
 }
@@ -48,13 +48,31 @@ namespace V32
     // used as limit of local port numbers
     const int32_t SPU_LastPort = (int32_t)SPU_LocalPorts::ChannelPosition;
     
+    // compressed sounds are stored in independent blocks
+    // of this many samples, so that playback can start
+    // at any position without decoding the whole sound
+    const int32_t SPUADPCMBlockSamples = 256;
+    
     
     // =============================================================================
     //      SPU DATA STRUCTURES
     // =============================================================================
     
     
+    // state needed to start decoding an ADPCM block:
+    // initial sample and step index for each side
     typedef struct
+    {
+        SPUSample InitialSample;
+        uint8_t LeftStepIndex;
+        uint8_t RightStepIndex;
+        uint16_t Padding;
+    }
+    SPUADPCMBlockHeader;
+    
+    // -----------------------------------------------------------------------------
+    
+    typedef struct SPUSound
     {
         // accesible ports
         int32_t Length;
@@ -64,6 +82,16 @@ namespace V32
         
         // actual sound samples
         std::vector< SPUSample > Samples;
+        
+        // same samples when compressed as 4-bit ADPCM
+        // (1 byte per sample: left is the low nibble);
+        // when these are used, Samples is left empty
+        std::vector< SPUADPCMBlockHeader > ADPCMBlocks;
+        std::vector< uint8_t > ADPCMData;
+        
+        // sounds with the same samples as a previous one
+        // read them from it, and keep no samples of their own
+        const struct SPUSound* SharedSamples;
     }
     SPUSound;
     
@@ -82,6 +110,35 @@ namespace V32
     }
     SPUChannel;
     
+    // -----------------------------------------------------------------------------
+    
+    // each channel keeps the last ADPCM block it played decoded
+    // here; decoding is incremental, so sequential playback
+    // only decodes every sample once
+    typedef struct
+    {
+        const SPUSound* Sound;
+        int32_t Block;
+        int32_t DecodedSamples;
+        int32_t LeftPredictor, RightPredictor;
+        int32_t LeftStepIndex, RightStepIndex;
+        SPUSample Samples[ SPUADPCMBlockSamples ];
+    }
+    SPUDecodeCache;
+    
+    // -----------------------------------------------------------------------------
+    
+    // CPU cost of the mixer, which includes decoding
+    // compressed sounds (frames with no active channels
+    // just output silence and are not counted)
+    typedef struct
+    {
+        uint64_t MixedFrames;
+        uint64_t DecodedSamples;
+        uint64_t MixingNanoseconds;
+    }
+    SPUMixingStatistics;
+    
     
     // =============================================================================
     //      V32 SPU CLASS
@@ -110,9 +167,21 @@ namespace V32
             // sound channels
             SPUChannel Channels[ Constants::SPUSoundChannels ];
             
+            // IDs of the channels that are currently playing,
+            // so that the mixer does not need to check all 16
+            int32_t ActiveChannelIDs[ Constants::SPUSoundChannels ];
+            int32_t NumberOfActiveChannels;
+            
             // sound buffer configuration
             SPUOutputBuffer OutputBuffer;
             
+            // optional compression of loaded sounds
+            bool CompressSounds;
+            SPUDecodeCache DecodeCaches[ Constants::SPUSoundChannels ];
+            
+            // measured to compare compressed and uncompressed sounds
+            SPUMixingStatistics MixingStatistics;
+            
         public:
             
             // instance handling
@@ -122,6 +191,9 @@ namespace V32
             // handling of audio resources
             void LoadSound( SPUSound& TargetSound, SPUSample* Samples, unsigned NumberOfSamples );
             void UnloadSound( SPUSound& TargetSound );
+            void CompressSound( SPUSound& TargetSound, SPUSample* Samples, unsigned NumberOfSamples );
+            void ShareSound( SPUSound& TargetSound, const SPUSound& SourceSound );
+            void InvalidateDecodeCaches();
             
             // I/O bus connection
             virtual bool ReadPort( int32_t LocalPort, V32Word& Result );
@@ -140,8 +212,14 @@ namespace V32
             void StopAllChannels();
             
             // generate output sound
+            void UpdateActiveChannels();
             SPUSound* GetChannelSound( SPUChannel* Channel );
+            SPUSample GetSoundSample( int ChannelID, const SPUSound* Sound, int32_t Position );
             void UpdateOutputBuffer();
+            
+            // metrics
+            SPUMixingStatistics GetMixingStatistics();
+            void ResetMixingStatistics();
     };
     
     
@@ -0,0 +1,287 @@
+// *****************************************************************************
+    // include console logic headers
+    #include "ConsoleLogic/V32Console.hpp"
+    
+    // include emulator headers
+    #include "EmulationThread.hpp"
+    #include "Globals.hpp"
+    #include "Logging.hpp"
+    
+    // include C/C++ headers
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    
+    // declare used namespaces
+    using namespace std;
+// *****************************************************************************
+
+
+// =============================================================================
+//      EMULATION THREAD: INSTANCE HANDLING
+// =============================================================================
+
+
+EmulationThread::EmulationThread()
+{
+    RecordingList = 0;
+    FrameRequested = false;
+    FrameRunning = false;
+    FrameFinished = false;
+    StopRequested = false;
+    UseWorker = false;
+    IsStarted = false;
+    
+    // no metrics yet
+    memset( &TotalStatistics, 0, sizeof( EmulationStatistics ) );
+}
+
+// -----------------------------------------------------------------------------
+
+EmulationThread::~EmulationThread()
+{
+    Stop();
+}
+
+
+// =============================================================================
+//      EMULATION THREAD: THREAD HANDLING
+// =============================================================================
+
+
+void EmulationThread::Start( bool WithWorker )
+{
+    Stop();
+    
+    if( WithWorker )
+      LOG( "Starting emulation thread" );
+    else
+      LOG( "Recording video commands for each frame" );
+    
+    CommandLists[ 0 ].Clear();
+    CommandLists[ 1 ].Clear();
+    RecordingList = 0;
+    
+    FrameRequested = false;
+    FrameRunning = false;
+    FrameFinished = false;
+    StopRequested = false;
+    FrameException = nullptr;
+    
+    memset( &TotalStatistics, 0, sizeof( EmulationStatistics ) );
+    UseWorker = WithWorker;
+    
+    if( UseWorker )
+      Worker = thread( &EmulationThread::WorkerLoop, this );
+    
+    IsStarted = true;
+}
+
+// -----------------------------------------------------------------------------
+
+// a frame being emulated is always completed first
+void EmulationThread::Stop()
+{
+    if( !IsStarted )
+      return;
+    
+    if( UseWorker )
+    {
+        LOG( "Stopping emulation thread" );
+        
+        {
+            lock_guard< mutex > Lock( FrameMutex );
+            StopRequested = true;
+        }
+        
+        FrameCondition.notify_all();
+        Worker.join();
+    }
+    
+    FrameRunning = false;
+    FrameFinished = false;
+    IsStarted = false;
+}
+
+// -----------------------------------------------------------------------------
+
+bool EmulationThread::IsRunning()
+{
+    return IsStarted;
+}
+
+// -----------------------------------------------------------------------------
+
+bool EmulationThread::IsThreaded()
+{
+    return IsStarted && UseWorker;
+}
+
+// -----------------------------------------------------------------------------
+
+void EmulationThread::WorkerLoop()
+{
+    while( true )
+    {
+        // wait until a frame is requested
+        {
+            unique_lock< mutex > Lock( FrameMutex );
+            FrameCondition.wait( Lock, [&]{ return StopRequested || FrameRequested; } );
+            
+            if( StopRequested )
+              return;
+            
+            FrameRequested = false;
+        }
+        
+        auto StartTime = chrono::steady_clock::now();
+        exception_ptr Exception = nullptr;
+        
+        try
+        {
+            Console.RunNextFrame( false );
+        }
+        catch( ... )
+        {
+            Exception = current_exception();
+        }
+        
+        double Milliseconds = chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+        
+        // report the frame as finished
+        {
+            lock_guard< mutex > Lock( FrameMutex );
+            TotalStatistics.EmulationMilliseconds += Milliseconds;
+            FrameException = Exception;
+            FrameRunning = false;
+            FrameFinished = true;
+        }
+        
+        FrameCondition.notify_all();
+    }
+}
+
+
+// =============================================================================
+//      EMULATION THREAD: FRAME CONTROL
+// =============================================================================
+
+
+// input has to be read before calling this,
+// since it is the start time for latency
+void EmulationThread::StartFrame()
+{
+    FrameStartTimes[ RecordingList ] = chrono::steady_clock::now();
+    
+    // without a worker the frame is finished on return
+    if( !UseWorker )
+    {
+        Console.RunNextFrame( false );
+        
+        TotalStatistics.EmulationMilliseconds += chrono::duration< double, milli >( chrono::steady_clock::now() - FrameStartTimes[ RecordingList ] ).count();
+        FrameFinished = true;
+        return;
+    }
+    
+    {
+        lock_guard< mutex > Lock( FrameMutex );
+        FrameRequested = true;
+        FrameRunning = true;
+        FrameFinished = false;
+    }
+    
+    FrameCondition.notify_all();
+}
+
+// -----------------------------------------------------------------------------
+
+void EmulationThread::WaitForFrame()
+{
+    exception_ptr Exception = nullptr;
+    
+    {
+        unique_lock< mutex > Lock( FrameMutex );
+        
+        if( FrameRunning )
+        {
+            auto StartTime = chrono::steady_clock::now();
+            FrameCondition.wait( Lock, [&]{ return !FrameRunning; } );
+            TotalStatistics.WaitMilliseconds += chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+        }
+        
+        swap( Exception, FrameException );
+    }
+    
+    // errors are raised in the front-end thread
+    if( Exception )
+      rethrow_exception( Exception );
+}
+
+// -----------------------------------------------------------------------------
+
+bool EmulationThread::HasFinishedFrame()
+{
+    return FrameFinished;
+}
+
+// -----------------------------------------------------------------------------
+
+// swaps the lists, so the finished one can be replayed
+// while the next frame is recorded into the other one
+VideoCommandList& EmulationThread::TakeFinishedFrame()
+{
+    int FinishedList = RecordingList;
+    RecordingList = 1 - RecordingList;
+    CommandLists[ RecordingList ].Clear();
+    FrameFinished = false;
+    
+    TotalStatistics.Commands += CommandLists[ FinishedList ].GetNumberOfCommands();
+    PresentStartTime = chrono::steady_clock::now();
+    return CommandLists[ FinishedList ];
+}
+
+// -----------------------------------------------------------------------------
+
+// call when the taken frame has been sent to the front-end
+// (duplicates are sent without being drawn again)
+void EmulationThread::FramePresented( bool Duplicate )
+{
+    auto Now = chrono::steady_clock::now();
+    int PresentedList = 1 - RecordingList;
+    double Latency = chrono::duration< double, milli >( Now - FrameStartTimes[ PresentedList ] ).count();
+    
+    TotalStatistics.Frames++;
+    TotalStatistics.DuplicateFrames += (Duplicate? 1 : 0);
+    TotalStatistics.PresentMilliseconds += chrono::duration< double, milli >( Now - PresentStartTime ).count();
+    TotalStatistics.LatencyMilliseconds += Latency;
+    TotalStatistics.MaximumLatencyMilliseconds = max( TotalStatistics.MaximumLatencyMilliseconds, Latency );
+}
+
+// -----------------------------------------------------------------------------
+
+// used when the console state is replaced (reset or
+// savestate load), so that the frame emulated ahead
+// and anything recorded so far are not shown
+void EmulationThread::DiscardFrame()
+{
+    WaitForFrame();
+    CommandLists[ RecordingList ].Clear();
+    FrameFinished = false;
+}
+
+// -----------------------------------------------------------------------------
+
+VideoCommandList& EmulationThread::GetRecordingList()
+{
+    return CommandLists[ RecordingList ];
+}
+
+
+// =============================================================================
+//      EMULATION THREAD: METRICS
+// =============================================================================
+
+
+EmulationStatistics EmulationThread::GetTotalStatistics()
+{
+    return TotalStatistics;
+}
@@ -0,0 +1,114 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef EMULATIONTHREAD_HPP
+    #define EMULATIONTHREAD_HPP
+    
+    // include emulator headers
+    #include "VideoCommandList.hpp"
+    
+    // include C/C++ headers
+    #include <thread>               // [ C++ STL ] Threads
+    #include <mutex>                // [ C++ STL ] Mutexes
+    #include <condition_variable>   // [ C++ STL ] Condition variables
+    #include <exception>            // [ C++ STL ] Exceptions
+    #include <chrono>               // [ C++ STL ] Time measurement
+// *****************************************************************************
+
+
+// =============================================================================
+//      EMULATION STATISTICS
+// =============================================================================
+
+
+typedef struct
+{
+    unsigned Frames;
+    unsigned DuplicateFrames;
+    unsigned Commands;
+    double EmulationMilliseconds;       // console time, in the worker thread
+    double WaitMilliseconds;            // front-end thread blocked by the worker
+    double PresentMilliseconds;         // replaying commands up to video output
+    double LatencyMilliseconds;         // from input read to video output
+    double MaximumLatencyMilliseconds;
+}
+EmulationStatistics;
+
+
+// =============================================================================
+//      CONSOLE EMULATION IN A SEPARATE THREAD
+// =============================================================================
+
+
+// runs console frames in a worker thread, recording their
+// video commands; meanwhile the front-end thread replays
+// the previous frame's commands with OpenGL, so rendering
+// and emulation overlap at the cost of 1 frame of latency;
+// without a worker, frames are still recorded (but run
+// in the caller's thread) so that duplicates can be found
+class EmulationThread
+{
+    private:
+        
+        // one list is recorded by the console
+        // while the other one is replayed
+        VideoCommandList CommandLists[ 2 ];
+        int RecordingList;
+        
+        // time when each list's frame read its input
+        std::chrono::steady_clock::time_point FrameStartTimes[ 2 ];
+        std::chrono::steady_clock::time_point PresentStartTime;
+        
+        // worker thread control
+        std::thread Worker;
+        std::mutex FrameMutex;
+        std::condition_variable FrameCondition;
+        bool FrameRequested;
+        bool FrameRunning;
+        bool FrameFinished;
+        bool StopRequested;
+        bool UseWorker;
+        bool IsStarted;
+        
+        // exceptions thrown by the console are passed
+        // to the front-end thread, same as when not threaded
+        std::exception_ptr FrameException;
+        
+        // metrics
+        EmulationStatistics TotalStatistics;
+        
+        // internal operations
+        void WorkerLoop();
+        
+    public:
+        
+        // instance handling
+        EmulationThread();
+       ~EmulationThread();
+        
+        // thread handling
+        void Start( bool WithWorker );
+        void Stop();
+        bool IsRunning();
+        bool IsThreaded();
+        
+        // frame control; the console can only be
+        // accessed when no frame is being emulated
+        void StartFrame();
+        void WaitForFrame();
+        bool HasFinishedFrame();
+        VideoCommandList& TakeFinishedFrame();
+        void FramePresented( bool Duplicate );
+        void DiscardFrame();
+        
+        // console callbacks are recorded here
+        VideoCommandList& GetRecordingList();
+        
+        // metrics
+        EmulationStatistics GetTotalStatistics();
+};
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
@@ -4,6 +4,11 @@
     
     // include emulator headers
     #include "VideoOutput.hpp"
+    #include "SoftwareRenderer.hpp"
+    #include "EmulationThread.hpp"
+    #include "AudioOutput.hpp"
+    #include "AudioResampler.hpp"
+    #include "CaptureOutput.hpp"
     #include "Globals.hpp"
     #include "Logging.hpp"
     
@@ -22,7 +27,13 @@ V32::V32Console Console;
 
 // wrappers for console I/O operation
 VideoOutput Video;
+SoftwareRenderer SoftwareVideo;
+bool UseSoftwareRendering = false;
+EmulationThread Emulation;
 V32::SPUOutputBuffer AudioBuffer;
+AudioOutput Audio;
+AudioResampler Resampler;
+CaptureOutput Capture;
 string LoadedCartridgePath;
 string LoadedMemoryCardPath;
 
@@ -60,44 +71,43 @@ namespace CallbackFunctions
     
     // -----------------------------------------------------------------------------
     
+    void DrawRegion( const V32::GPURegionDrawing& Drawing )
+    {
+        Video.AddRegionToQueue( Drawing );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
     void SetMultiplyColor( V32::GPUColor NewMultiplyColor )
     {
-        // GPU colors are not directly comparable so use words
-        V32::V32Word New, Old;
-        New.AsColor = NewMultiplyColor;
-        Old.AsColor = Video.GetMultiplyColor();
-        
-        // set multiply color only when needed, so that
-        // quad groups are not broken without need
-        if( New.AsInteger != Old.AsInteger )
-          Video.SetMultiplyColor( NewMultiplyColor );
+        // multiply color is stored in each queued vertex,
+        // so changing it never breaks quad groups
+        Video.SetMultiplyColor( NewMultiplyColor );
     }
     
     // -----------------------------------------------------------------------------
     
     void SetBlendingMode( int NewBlendingMode )
     {
-        // set blending mode only when needed, so that
-        // quad groups are not broken without need
-        if( NewBlendingMode != (int)Video.GetBlendingMode() )
-          Video.SetBlendingMode( (V32::IOPortValues)NewBlendingMode );
+        // blending is only applied when the next quad is
+        // drawn, so changing it never breaks quad groups
+        Video.SetBlendingMode( (V32::IOPortValues)NewBlendingMode );
     }
     
     // -----------------------------------------------------------------------------
     
     void SelectTexture( int GPUTextureID )
     {
-        // select texture only when needed, so that
-        // quad groups are not broken without need
-        if( GPUTextureID != Video.GetSelectedTexture() )
-          Video.SelectTexture( GPUTextureID );
+        // textures are only bound when the next quad is
+        // drawn, so selecting one never breaks quad groups
+        Video.SelectTexture( GPUTextureID );
     }
     
     // -----------------------------------------------------------------------------
     
-    void LoadTexture( int GPUTextureID, void* Pixels )
+    void LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height )
     {
-        Video.LoadTexture( GPUTextureID, Pixels );
+        Video.LoadTexture( GPUTextureID, Pixels, Width, Height );
     }
     
     // -----------------------------------------------------------------------------
@@ -117,6 +127,20 @@ namespace CallbackFunctions
     
     // -----------------------------------------------------------------------------
     
+    void ReserveCartridgeTextures( int NumberOfTextures )
+    {
+        Video.ReserveCartridgeTextures( NumberOfTextures );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    bool ShareTexture( int GPUTextureID, int SourceTextureID )
+    {
+        return Video.ShareTexture( GPUTextureID, SourceTextureID );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
     void LogLine( const string& Message )
     {
         LOG( Message );
@@ -129,3 +153,123 @@ namespace CallbackFunctions
         THROW( Message );
     }
 }
+
+
+// =============================================================================
+//      CALLBACK FUNCTIONS FOR THE SOFTWARE RENDERER
+// =============================================================================
+
+
+namespace SoftwareCallbackFunctions
+{
+    void ClearScreen( V32::GPUColor ClearColor )
+    {
+        SoftwareVideo.ClearScreen( ClearColor );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void DrawQuad( V32::GPUQuad& DrawnQuad )
+    {
+        SoftwareVideo.DrawQuad( DrawnQuad );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void SetMultiplyColor( V32::GPUColor NewMultiplyColor )
+    {
+        SoftwareVideo.SetMultiplyColor( NewMultiplyColor );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void SetBlendingMode( int NewBlendingMode )
+    {
+        SoftwareVideo.SetBlendingMode( NewBlendingMode );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void SelectTexture( int GPUTextureID )
+    {
+        SoftwareVideo.SelectTexture( GPUTextureID );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height )
+    {
+        SoftwareVideo.LoadTexture( GPUTextureID, Pixels, Width, Height );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void UnloadCartridgeTextures()
+    {
+        for( int i = 0; i < V32::Constants::GPUMaximumCartridgeTextures; i++ )
+          SoftwareVideo.UnloadTexture( i );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void UnloadBiosTexture()
+    {
+        SoftwareVideo.UnloadTexture( -1 );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    bool ShareTexture( int GPUTextureID, int SourceTextureID )
+    {
+        return SoftwareVideo.ShareTexture( GPUTextureID, SourceTextureID );
+    }
+}
+
+
+// =============================================================================
+//      CALLBACK FUNCTIONS FOR THE EMULATION THREAD
+// =============================================================================
+
+
+namespace RecordingCallbackFunctions
+{
+    void ClearScreen( V32::GPUColor ClearColor )
+    {
+        Emulation.GetRecordingList().ClearScreen( ClearColor );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void DrawQuad( V32::GPUQuad& DrawnQuad )
+    {
+        Emulation.GetRecordingList().DrawQuad( DrawnQuad );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void DrawRegion( const V32::GPURegionDrawing& Drawing )
+    {
+        Emulation.GetRecordingList().DrawRegion( Drawing );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void SetMultiplyColor( V32::GPUColor NewMultiplyColor )
+    {
+        Emulation.GetRecordingList().SetMultiplyColor( NewMultiplyColor );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void SetBlendingMode( int NewBlendingMode )
+    {
+        Emulation.GetRecordingList().SetBlendingMode( NewBlendingMode );
+    }
+    
+    // -----------------------------------------------------------------------------
+    
+    void SelectTexture( int GPUTextureID )
+    {
+        Emulation.GetRecordingList().SelectTexture( GPUTextureID );
+    }
+}
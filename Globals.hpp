@@ -18,6 +18,11 @@
     // (to avoid needing to include all headers here)
     namespace V32{ class V32Console; }
     class VideoOutput;
+    class SoftwareRenderer;
+    class EmulationThread;
+    class AudioOutput;
+    class AudioResampler;
+    class CaptureOutput;
 // *****************************************************************************
 
 
@@ -31,7 +36,13 @@ extern V32::V32Console Console;
 
 // wrappers for console I/O operation
 extern VideoOutput Video;
+extern SoftwareRenderer SoftwareVideo;
+extern bool UseSoftwareRendering;
+extern EmulationThread Emulation;
 extern V32::SPUOutputBuffer AudioBuffer;
+extern AudioOutput Audio;
+extern AudioResampler Resampler;
+extern CaptureOutput Capture;
 extern std::string LoadedCartridgePath;
 extern std::string LoadedMemoryCardPath;
 
@@ -58,18 +69,52 @@ namespace CallbackFunctions
     // video functions callable by the console
     void ClearScreen( V32::GPUColor ClearColor );
     void DrawQuad( V32::GPUQuad& DrawnQuad );
+    void DrawRegion( const V32::GPURegionDrawing& Drawing );
     void SetMultiplyColor( V32::GPUColor NewMultiplyColor );
     void SetBlendingMode( int NewBlendingMode );
     void SelectTexture( int GPUTextureID );
-    void LoadTexture( int GPUTextureID, void* Pixels );
+    void LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height );
     void UnloadCartridgeTextures();
     void UnloadBiosTexture();
+    void ReserveCartridgeTextures( int NumberOfTextures );
+    bool ShareTexture( int GPUTextureID, int SourceTextureID );
     
     // log functions callable by the console
     void LogLine( const std::string& Message );
     void ThrowException( const std::string& Message );
 }
 
+// -----------------------------------------------------------------------------
+
+// video functions for the software renderer
+namespace SoftwareCallbackFunctions
+{
+    void ClearScreen( V32::GPUColor ClearColor );
+    void DrawQuad( V32::GPUQuad& DrawnQuad );
+    void SetMultiplyColor( V32::GPUColor NewMultiplyColor );
+    void SetBlendingMode( int NewBlendingMode );
+    void SelectTexture( int GPUTextureID );
+    void LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height );
+    void UnloadCartridgeTextures();
+    void UnloadBiosTexture();
+    bool ShareTexture( int GPUTextureID, int SourceTextureID );
+}
+
+// -----------------------------------------------------------------------------
+
+// video functions that record commands for the emulation
+// thread (texture loads happen outside of frames, so
+// for those the regular callbacks are still used)
+namespace RecordingCallbackFunctions
+{
+    void ClearScreen( V32::GPUColor ClearColor );
+    void DrawQuad( V32::GPUQuad& DrawnQuad );
+    void DrawRegion( const V32::GPURegionDrawing& Drawing );
+    void SetMultiplyColor( V32::GPUColor NewMultiplyColor );
+    void SetBlendingMode( int NewBlendingMode );
+    void SelectTexture( int GPUTextureID );
+}
+
 
 // *****************************************************************************
     // end include guard
@@ -5,6 +5,7 @@
     // include emulator headers
     #include "Savestates.hpp"
     #include "VideoOutput.hpp"
+    #include "SoftwareRenderer.hpp"
     #include "Globals.hpp"
     #include "Logging.hpp"
     
@@ -180,6 +181,15 @@ bool LoadGPUState( const GPUState& State )
     
     GPU.PointedRegion = &GPU.PointedTexture->Regions[ GPU.SelectedRegion ];
     
+    // the software renderer has no OpenGL context
+    if( UseSoftwareRendering )
+    {
+        SoftwareVideo.SelectTexture( GPU.SelectedTexture );
+        SoftwareVideo.SetMultiplyColor( GPU.MultiplyColor );
+        SoftwareVideo.SetBlendingMode( GPU.ActiveBlending );
+        return true;
+    }
+    
     // reset any previous OpenGL errors
     while( glGetError() != GL_NO_ERROR )
     {
@@ -206,6 +216,7 @@ void LoadSPUState( const SPUState& State )
     
     // write all channels as adjacent
     memcpy( &SPU.Channels, State.Channels, sizeof(State.Channels) );
+    SPU.UpdateActiveChannels();
     
     // copy the BIOS sound
     memcpy( &SPU.BiosSound, &State.BiosSound, sizeof(SPUSoundState) );
@@ -0,0 +1,710 @@
+// *****************************************************************************
+    // include common Vircon headers
+    #include "VirconDefinitions/Constants.hpp"
+    #include "VirconDefinitions/Enumerations.hpp"
+    
+    // include emulator headers
+    #include "SoftwareRenderer.hpp"
+    #include "Logging.hpp"
+    
+    // include C/C++ headers
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <cmath>            // [ ANSI C ] Mathematics
+    #include <chrono>           // [ C++ STL ] Time measurement
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    
+    // include SIMD intrinsics when available
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+      #include <emmintrin.h>
+      #define SOFTWARE_RENDERER_SSE2
+    #endif
+    
+    // declare used namespaces
+    using namespace std;
+    using namespace V32;
+// *****************************************************************************
+
+
+// =============================================================================
+//      AUXILIARY FUNCTIONS FOR PIXEL DATA
+// =============================================================================
+
+
+// pixels are handled as 32-bit values 0xAARRGGBB, which
+// for XRGB8888 output is just the alpha in the X channel
+static inline uint32_t PackColor( GPUColor Color )
+{
+    return ((uint32_t)Color.A << 24) | ((uint32_t)Color.R << 16) | ((uint32_t)Color.G << 8) | Color.B;
+}
+
+// -----------------------------------------------------------------------------
+
+// divides by 255 with rounding to nearest, exact
+// for all products of 2 color components
+static inline uint32_t Divide255( uint32_t Value )
+{
+    Value += 128;
+    return (Value + (Value >> 8)) >> 8;
+}
+
+// -----------------------------------------------------------------------------
+
+// blends a pixel with the same operations as OpenGL does
+// for each blending mode (with a single final rounding)
+static inline uint32_t BlendPixel( uint32_t Source, uint32_t Destination, uint32_t Multiply, int32_t BlendingMode )
+{
+    uint32_t SourceAlpha = Divide255( (Source >> 24) * (Multiply >> 24) );
+    uint32_t Result = 0;
+    
+    for( int Shift = 0; Shift < 32; Shift += 8 )
+    {
+        uint32_t SourceValue = Divide255( ((Source >> Shift) & 255) * ((Multiply >> Shift) & 255) );
+        int32_t DestinationValue = (Destination >> Shift) & 255;
+        int32_t ResultValue;
+        
+        if( BlendingMode == (int32_t)IOPortValues::GPUBlendingMode_Alpha )
+          ResultValue = Divide255( SourceValue * SourceAlpha + DestinationValue * (255 - SourceAlpha) );
+        
+        else if( BlendingMode == (int32_t)IOPortValues::GPUBlendingMode_Add )
+          ResultValue = min( 255, DestinationValue + (int32_t)Divide255( SourceValue * SourceAlpha ) );
+        
+        else
+          ResultValue = max( 0, DestinationValue - (int32_t)Divide255( SourceValue * SourceAlpha ) );
+        
+        Result |= (uint32_t)ResultValue << Shift;
+    }
+    
+    return Result;
+}
+
+// -----------------------------------------------------------------------------
+
+#if defined(SOFTWARE_RENDERER_SSE2)
+
+// rounded division by 255 for 8 unsigned 16-bit values
+static inline __m128i Divide255SSE2( __m128i Values )
+{
+    Values = _mm_add_epi16( Values, _mm_set1_epi16( 128 ) );
+    Values = _mm_add_epi16( Values, _mm_srli_epi16( Values, 8 ) );
+    return _mm_srli_epi16( Values, 8 );
+}
+
+// -----------------------------------------------------------------------------
+
+// applies multiply color and blending to 2 pixels given
+// as 16-bit channels; alpha blending gives final values,
+// other modes give the amount to add or subtract
+static inline __m128i BlendPixelPairSSE2( __m128i Source, __m128i Destination, __m128i Multiply, bool IsAlpha )
+{
+    Source = Divide255SSE2( _mm_mullo_epi16( Source, Multiply ) );
+    
+    // replicate source alpha in all channels of each pixel
+    __m128i Alpha = _mm_shufflelo_epi16( Source, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+    Alpha = _mm_shufflehi_epi16( Alpha, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+    
+    if( !IsAlpha )
+      return Divide255SSE2( _mm_mullo_epi16( Source, Alpha ) );
+    
+    __m128i InverseAlpha = _mm_sub_epi16( _mm_set1_epi16( 255 ), Alpha );
+    __m128i Sum = _mm_add_epi16( _mm_mullo_epi16( Source, Alpha ), _mm_mullo_epi16( Destination, InverseAlpha ) );
+    return Divide255SSE2( Sum );
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+
+// blends a span of source pixels into the frame; 4 pixels are
+// processed at a time with SSE2 (16-bit channels are enough
+// for all the products) and the rest one by one
+static void BlendSpan( uint32_t* Destination, const uint32_t* Source, int Count, uint32_t Multiply, int32_t BlendingMode )
+{
+    int i = 0;
+    
+    #if defined(SOFTWARE_RENDERER_SSE2)
+      
+      const __m128i Zero = _mm_setzero_si128();
+      const __m128i MultiplyChannels = _mm_unpacklo_epi8( _mm_set1_epi32( Multiply ), Zero );
+      const bool IsAlpha = (BlendingMode == (int32_t)IOPortValues::GPUBlendingMode_Alpha);
+      const bool IsAdd = (BlendingMode == (int32_t)IOPortValues::GPUBlendingMode_Add);
+      
+      for( ; i + 4 <= Count; i += 4 )
+      {
+          __m128i SourcePixels = _mm_loadu_si128( (const __m128i*)&Source[ i ] );
+          __m128i DestinationPixels = _mm_loadu_si128( (const __m128i*)&Destination[ i ] );
+          
+          __m128i Low = BlendPixelPairSSE2
+          (
+              _mm_unpacklo_epi8( SourcePixels, Zero ),
+              _mm_unpacklo_epi8( DestinationPixels, Zero ),
+              MultiplyChannels,
+              IsAlpha
+          );
+          
+          __m128i High = BlendPixelPairSSE2
+          (
+              _mm_unpackhi_epi8( SourcePixels, Zero ),
+              _mm_unpackhi_epi8( DestinationPixels, Zero ),
+              MultiplyChannels,
+              IsAlpha
+          );
+          
+          __m128i Result = _mm_packus_epi16( Low, High );
+          
+          if( IsAdd )
+            Result = _mm_adds_epu8( DestinationPixels, Result );
+          
+          else if( !IsAlpha )
+            Result = _mm_subs_epu8( DestinationPixels, Result );
+          
+          _mm_storeu_si128( (__m128i*)&Destination[ i ], Result );
+      }
+    
+    #endif
+    
+    for( ; i < Count; i++ )
+      Destination[ i ] = BlendPixel( Source[ i ], Destination[ i ], Multiply, BlendingMode );
+}
+
+
+// =============================================================================
+//      SOFTWARE RENDERER: INSTANCE HANDLING
+// =============================================================================
+
+
+SoftwareRenderer::SoftwareRenderer()
+{
+    // default values
+    SelectedTexture = -1;
+    MultiplyColor = 0xFFFFFFFF;
+    BlendingMode = (int32_t)IOPortValues::GPUBlendingMode_Alpha;
+    
+    // no threads yet
+    WorkGeneration = 0;
+    FinishedWorkers = 0;
+    NextBand = 0;
+    StopRequested = false;
+    IsInitialized = false;
+    
+    // no metrics yet
+    memset( &TotalStatistics, 0, sizeof( SoftwareStatistics ) );
+    RenderedFrames = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+    Destroy();
+}
+
+
+// =============================================================================
+//      SOFTWARE RENDERER: INITIALIZATION
+// =============================================================================
+
+
+// the emulation thread renders bands too, so
+// only the remaining threads need to be created
+void SoftwareRenderer::Initialize( unsigned NumberOfThreads )
+{
+    Destroy();
+    
+    NumberOfThreads = max( 1u, min( NumberOfThreads, (unsigned)SOFTWARE_MAXIMUM_THREADS ) );
+    LOG( "Initializing software renderer with " + to_string( NumberOfThreads ) + " threads" );
+    
+    #if defined(SOFTWARE_RENDERER_SSE2)
+      LOG( "Software renderer will use SSE2 blending" );
+    #endif
+    
+    Frame.assign( Constants::ScreenWidth * Constants::ScreenHeight, 0 );
+    CartridgeTextures.resize( Constants::GPUMaximumCartridgeTextures );
+    CartridgeTextureSources.resize( Constants::GPUMaximumCartridgeTextures );
+    
+    for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+      CartridgeTextureSources[ i ] = i;
+    
+    Commands.reserve( 1024 );
+    
+    SelectedTexture = -1;
+    MultiplyColor = 0xFFFFFFFF;
+    BlendingMode = (int32_t)IOPortValues::GPUBlendingMode_Alpha;
+    
+    StopRequested = false;
+    WorkGeneration = 0;
+    
+    for( unsigned i = 1; i < NumberOfThreads; i++ )
+      Workers.emplace_back( &SoftwareRenderer::WorkerLoop, this );
+    
+    memset( &TotalStatistics, 0, sizeof( SoftwareStatistics ) );
+    RenderedFrames = 0;
+    IsInitialized = true;
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::Destroy()
+{
+    if( !IsInitialized )
+      return;
+    
+    LOG( "Destroying software renderer" );
+    
+    // stop all worker threads
+    {
+        lock_guard< mutex > Lock( WorkMutex );
+        StopRequested = true;
+    }
+    
+    WorkCondition.notify_all();
+    
+    for( auto& Worker: Workers )
+      Worker.join();
+    
+    Workers.clear();
+    
+    // release all textures
+    BiosTexture = SoftwareTexture();
+    CartridgeTextures.clear();
+    CartridgeTextureSources.clear();
+    Commands.clear();
+    
+    IsInitialized = false;
+}
+
+
+// =============================================================================
+//      SOFTWARE RENDERER: RENDER FUNCTIONS
+// =============================================================================
+
+
+// clears are drawn as full screen quads using the
+// current blending mode, same as the OpenGL renderer
+void SoftwareRenderer::ClearScreen( GPUColor ClearColor )
+{
+    // an opaque clear with alpha blending hides
+    // everything drawn before it in this frame
+    if( ClearColor.A == 255 && BlendingMode == (int32_t)IOPortValues::GPUBlendingMode_Alpha )
+      Commands.clear();
+    
+    SoftwareDrawCommand Command;
+    Command.Quad.Vertices[ 0 ] = GPUPoint{ 0, 0, 0, 0 };
+    Command.Quad.Vertices[ 1 ] = GPUPoint{ Constants::ScreenWidth, 0, 0, 0 };
+    Command.Quad.Vertices[ 2 ] = GPUPoint{ 0, Constants::ScreenHeight, 0, 0 };
+    Command.Quad.Vertices[ 3 ] = GPUPoint{ Constants::ScreenWidth, Constants::ScreenHeight, 0, 0 };
+    Command.Texture = nullptr;
+    Command.MultiplyColor = PackColor( ClearColor );
+    Command.BlendingMode = BlendingMode;
+    Command.MinRow = 0;
+    Command.MaxRow = Constants::ScreenHeight - 1;
+    
+    Commands.push_back( Command );
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::DrawQuad( const GPUQuad& Quad )
+{
+    // like an incomplete OpenGL texture,
+    // missing textures draw nothing
+    const SoftwareTexture* Texture = GetTexture( SelectedTexture );
+    
+    if( !Texture )
+      return;
+    
+    SoftwareDrawCommand Command;
+    Command.Quad = Quad;
+    Command.Texture = Texture;
+    Command.MultiplyColor = MultiplyColor;
+    Command.BlendingMode = BlendingMode;
+    
+    // find the rows this quad can cover
+    float MinY = Quad.Vertices[ 0 ].y, MaxY = MinY;
+    
+    for( int i = 1; i < 4; i++ )
+    {
+        MinY = min( MinY, Quad.Vertices[ i ].y );
+        MaxY = max( MaxY, Quad.Vertices[ i ].y );
+    }
+    
+    // quads fully outside of the screen are discarded
+    if( MaxY <= 0 || MinY >= Constants::ScreenHeight )
+      return;
+    
+    Command.MinRow = max( 0, (int)floorf( MinY ) );
+    Command.MaxRow = min( Constants::ScreenHeight - 1, (int)ceilf( MaxY ) );
+    Commands.push_back( Command );
+}
+
+// -----------------------------------------------------------------------------
+
+// renders all draws recorded in this frame
+void SoftwareRenderer::RenderFrame()
+{
+    if( Commands.empty() )
+      return;
+    
+    auto StartTime = chrono::steady_clock::now();
+    RenderBands();
+    
+    TotalStatistics.Quads += Commands.size();
+    TotalStatistics.RenderMilliseconds += chrono::duration< double, milli >( chrono::steady_clock::now() - StartTime ).count();
+    RenderedFrames++;
+    Commands.clear();
+}
+
+// -----------------------------------------------------------------------------
+
+const uint32_t* SoftwareRenderer::GetFrame()
+{
+    return Frame.data();
+}
+
+
+// =============================================================================
+//      SOFTWARE RENDERER: PARALLEL RASTERIZATION
+// =============================================================================
+
+
+void SoftwareRenderer::RenderBands()
+{
+    const int NumberOfBands = (Constants::ScreenHeight + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+    NextBand = 0;
+    
+    // start a new generation of work for all threads
+    if( !Workers.empty() )
+    {
+        lock_guard< mutex > Lock( WorkMutex );
+        FinishedWorkers = 0;
+        WorkGeneration++;
+    }
+    
+    WorkCondition.notify_all();
+    
+    // this thread renders bands too
+    int Band;
+    
+    while( (Band = NextBand++) < NumberOfBands )
+      RenderBand( Band * SOFTWARE_BAND_HEIGHT, min( (Band + 1) * SOFTWARE_BAND_HEIGHT, Constants::ScreenHeight ) - 1 );
+    
+    // wait until the other threads are done
+    if( !Workers.empty() )
+    {
+        unique_lock< mutex > Lock( WorkMutex );
+        DoneCondition.wait( Lock, [this]{ return FinishedWorkers == Workers.size(); } );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::WorkerLoop()
+{
+    const int NumberOfBands = (Constants::ScreenHeight + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+    unsigned SeenGeneration = 0;
+    
+    while( true )
+    {
+        // wait until there is a new frame to render
+        {
+            unique_lock< mutex > Lock( WorkMutex );
+            WorkCondition.wait( Lock, [&]{ return StopRequested || WorkGeneration != SeenGeneration; } );
+            
+            if( StopRequested )
+              return;
+            
+            SeenGeneration = WorkGeneration;
+        }
+        
+        int Band;
+        
+        while( (Band = NextBand++) < NumberOfBands )
+          RenderBand( Band * SOFTWARE_BAND_HEIGHT, min( (Band + 1) * SOFTWARE_BAND_HEIGHT, Constants::ScreenHeight ) - 1 );
+        
+        // report this thread as finished
+        {
+            lock_guard< mutex > Lock( WorkMutex );
+            FinishedWorkers++;
+        }
+        
+        DoneCondition.notify_one();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// each band applies all draws in order, so pixels
+// get the same result as when drawing sequentially
+void SoftwareRenderer::RenderBand( int FirstRow, int LastRow )
+{
+    for( const SoftwareDrawCommand& Command: Commands )
+    {
+        if( Command.MaxRow < FirstRow || Command.MinRow > LastRow )
+          continue;
+        
+        // same 2 triangles used by the OpenGL renderer
+        const GPUPoint* Triangle1[ 3 ] = { &Command.Quad.Vertices[ 0 ], &Command.Quad.Vertices[ 1 ], &Command.Quad.Vertices[ 2 ] };
+        const GPUPoint* Triangle2[ 3 ] = { &Command.Quad.Vertices[ 1 ], &Command.Quad.Vertices[ 2 ], &Command.Quad.Vertices[ 3 ] };
+        
+        RenderTriangle( Command, Triangle1, FirstRow, LastRow );
+        RenderTriangle( Command, Triangle2, FirstRow, LastRow );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// rasterizes a triangle sampling pixel centers; edges
+// shared by 2 triangles are computed from the same
+// ordered vertices, and each pixel along them is
+// included by only one side (as with OpenGL rules)
+void SoftwareRenderer::RenderTriangle( const SoftwareDrawCommand& Command, const GPUPoint* Vertices[ 3 ], int FirstRow, int LastRow )
+{
+    const GPUPoint& V0 = *Vertices[ 0 ];
+    const GPUPoint& V1 = *Vertices[ 1 ];
+    const GPUPoint& V2 = *Vertices[ 2 ];
+    
+    float Determinant = (V1.x - V0.x) * (V2.y - V0.y) - (V2.x - V0.x) * (V1.y - V0.y);
+    
+    if( Determinant == 0 )
+      return;
+    
+    // texture coordinates, in texels, are an affine
+    // function of the screen position for 2D drawing
+    const float TextureSize = Constants::GPUTextureSize;
+    float U0 = V0.texture_x * TextureSize, U1 = V1.texture_x * TextureSize, U2 = V2.texture_x * TextureSize;
+    float T0 = V0.texture_y * TextureSize, T1 = V1.texture_y * TextureSize, T2 = V2.texture_y * TextureSize;
+    
+    float dUdx = ((U1 - U0) * (V2.y - V0.y) - (U2 - U0) * (V1.y - V0.y)) / Determinant;
+    float dUdy = ((U2 - U0) * (V1.x - V0.x) - (U1 - U0) * (V2.x - V0.x)) / Determinant;
+    float dTdx = ((T1 - T0) * (V2.y - V0.y) - (T2 - T0) * (V1.y - V0.y)) / Determinant;
+    float dTdy = ((T2 - T0) * (V1.x - V0.x) - (T1 - T0) * (V2.x - V0.x)) / Determinant;
+    
+    // prepare the non-horizontal edges, ordered from top to bottom
+    struct { float TopX, TopY, BottomY, Slope; bool IsLeft; } Edges[ 3 ];
+    int NumberOfEdges = 0;
+    float MinY = V0.y, MaxY = V0.y;
+    
+    for( int e = 0; e < 3; e++ )
+    {
+        const GPUPoint* P = Vertices[ e ];
+        const GPUPoint* Q = Vertices[ (e + 1) % 3 ];
+        const GPUPoint* R = Vertices[ (e + 2) % 3 ];
+        
+        MinY = min( MinY, P->y );
+        MaxY = max( MaxY, P->y );
+        
+        if( P->y == Q->y )
+          continue;
+        
+        if( P->y > Q->y )
+          swap( P, Q );
+        
+        // the edge bounds the triangle from the left
+        // when the third vertex is to its right
+        float Cross = (Q->x - P->x) * (R->y - P->y) - (Q->y - P->y) * (R->x - P->x);
+        
+        Edges[ NumberOfEdges ].TopX = P->x;
+        Edges[ NumberOfEdges ].TopY = P->y;
+        Edges[ NumberOfEdges ].BottomY = Q->y;
+        Edges[ NumberOfEdges ].Slope = (Q->x - P->x) / (Q->y - P->y);
+        Edges[ NumberOfEdges ].IsLeft = (Cross < 0);
+        NumberOfEdges++;
+    }
+    
+    // rows whose pixel centers are within the triangle
+    int StartRow = max( FirstRow, (int)ceilf( MinY - 0.5f ) );
+    int EndRow = min( LastRow, (int)ceilf( MaxY - 0.5f ) - 1 );
+    
+    uint32_t SpanTexels[ Constants::ScreenWidth ];
+    
+    for( int Row = StartRow; Row <= EndRow; Row++ )
+    {
+        float CenterY = Row + 0.5f;
+        float LeftX = 0, RightX = Constants::ScreenWidth;
+        bool HasLeft = false, HasRight = false;
+        
+        for( int e = 0; e < NumberOfEdges; e++ )
+        {
+            if( CenterY < Edges[ e ].TopY || CenterY >= Edges[ e ].BottomY )
+              continue;
+            
+            float EdgeX = Edges[ e ].TopX + (CenterY - Edges[ e ].TopY) * Edges[ e ].Slope;
+            
+            if( Edges[ e ].IsLeft )
+            {
+                LeftX = (HasLeft? max( LeftX, EdgeX ) : EdgeX);
+                HasLeft = true;
+            }
+            
+            else
+            {
+                RightX = (HasRight? min( RightX, EdgeX ) : EdgeX);
+                HasRight = true;
+            }
+        }
+        
+        if( !HasLeft || !HasRight )
+          continue;
+        
+        // pixels whose centers are in [LeftX, RightX)
+        LeftX = max( LeftX, 0.0f );
+        RightX = min( RightX, (float)Constants::ScreenWidth );
+        int StartColumn = (int)ceilf( LeftX - 0.5f );
+        int EndColumn = (int)ceilf( RightX - 0.5f ) - 1;
+        
+        if( EndColumn < StartColumn )
+          continue;
+        
+        int Count = EndColumn - StartColumn + 1;
+        
+        // sample texels with nearest filtering and clamp to edge
+        if( Command.Texture )
+        {
+            float StartX = StartColumn + 0.5f - V0.x;
+            float BaseU = U0 + dUdx * StartX + dUdy * (CenterY - V0.y);
+            float BaseT = T0 + dTdx * StartX + dTdy * (CenterY - V0.y);
+            const float MaximumTexel = Constants::GPUTextureSize - 1;
+            const SoftwareTexture& Texture = *Command.Texture;
+            
+            // (after clamping to positive values,
+            // truncation gives the same as floor)
+            for( int i = 0; i < Count; i++ )
+            {
+                int TexelX = (int)min( max( BaseU + dUdx * i, 0.0f ), MaximumTexel );
+                int TexelY = (int)min( max( BaseT + dTdx * i, 0.0f ), MaximumTexel );
+                
+                if( TexelX < Texture.Width && TexelY < Texture.Height )
+                  SpanTexels[ i ] = Texture.Texels[ TexelY * Texture.Width + TexelX ];
+                else
+                  SpanTexels[ i ] = 0;
+            }
+        }
+        
+        // solid colors use a white texel
+        else for( int i = 0; i < Count; i++ )
+          SpanTexels[ i ] = 0xFFFFFFFF;
+        
+        uint32_t* Destination = &Frame[ Row * Constants::ScreenWidth + StartColumn ];
+        BlendSpan( Destination, SpanTexels, Count, Command.MultiplyColor, Command.BlendingMode );
+    }
+}
+
+
+// =============================================================================
+//      SOFTWARE RENDERER: COLOR AND TEXTURE STATE
+// =============================================================================
+
+
+void SoftwareRenderer::SetMultiplyColor( GPUColor NewMultiplyColor )
+{
+    MultiplyColor = PackColor( NewMultiplyColor );
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::SetBlendingMode( int NewBlendingMode )
+{
+    // ignore invalid values
+    if( NewBlendingMode != (int)IOPortValues::GPUBlendingMode_Alpha
+    &&  NewBlendingMode != (int)IOPortValues::GPUBlendingMode_Add
+    &&  NewBlendingMode != (int)IOPortValues::GPUBlendingMode_Subtract )
+      return;
+    
+    BlendingMode = NewBlendingMode;
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::SelectTexture( int GPUTextureID )
+{
+    SelectedTexture = GPUTextureID;
+}
+
+// -----------------------------------------------------------------------------
+
+const SoftwareTexture* SoftwareRenderer::GetTexture( int32_t GPUTextureID )
+{
+    const SoftwareTexture* Texture = &BiosTexture;
+    
+    if( GPUTextureID >= 0 )
+    {
+        if( GPUTextureID >= (int32_t)CartridgeTextures.size() )
+          return nullptr;
+        
+        Texture = &CartridgeTextures[ CartridgeTextureSources[ GPUTextureID ] ];
+    }
+    
+    return (Texture->Texels.empty()? nullptr : Texture);
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height )
+{
+    LOG( "Loading texture with ID = " + to_string(GPUTextureID) );
+    
+    SoftwareTexture& Texture = (GPUTextureID >= 0? CartridgeTextures[ GPUTextureID ] : BiosTexture);
+    const int NumberOfPixels = Width * Height;
+    Texture.Texels.resize( NumberOfPixels );
+    Texture.Width = Width;
+    Texture.Height = Height;
+    
+    // convert from RGBA bytes to our pixel format
+    const uint8_t* Source = (const uint8_t*)Pixels;
+    
+    for( int i = 0; i < NumberOfPixels; i++ )
+    {
+        Texture.Texels[ i ] = PackColor( GPUColor{ Source[ 0 ], Source[ 1 ], Source[ 2 ], Source[ 3 ] } );
+        Source += 4;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void SoftwareRenderer::UnloadTexture( int GPUTextureID )
+{
+    if( GPUTextureID >= 0 )
+    {
+        if( GPUTextureID < (int)CartridgeTextures.size() )
+        {
+            CartridgeTextures[ GPUTextureID ] = SoftwareTexture();
+            CartridgeTextureSources[ GPUTextureID ] = GPUTextureID;
+        }
+    }
+    
+    else BiosTexture = SoftwareTexture();
+}
+
+// -----------------------------------------------------------------------------
+
+// the texture will be drawn with the source's texels
+bool SoftwareRenderer::ShareTexture( int GPUTextureID, int SourceTextureID )
+{
+    UnloadTexture( GPUTextureID );
+    CartridgeTextureSources[ GPUTextureID ] = CartridgeTextureSources[ SourceTextureID ];
+    return true;
+}
+
+
+// =============================================================================
+//      SOFTWARE RENDERER: METRICS
+// =============================================================================
+
+
+SoftwareStatistics SoftwareRenderer::GetTotalStatistics()
+{
+    return TotalStatistics;
+}
+
+// -----------------------------------------------------------------------------
+
+unsigned SoftwareRenderer::GetRenderedFrames()
+{
+    return RenderedFrames;
+}
+
+// -----------------------------------------------------------------------------
+
+unsigned SoftwareRenderer::GetNumberOfThreads()
+{
+    return Workers.size() + 1;
+}
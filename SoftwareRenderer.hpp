@@ -0,0 +1,154 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef SOFTWARERENDERER_HPP
+    #define SOFTWARERENDERER_HPP
+    
+    // include console logic headers
+    #include "ConsoleLogic/ExternalInterfaces.hpp"
+    
+    // include C/C++ headers
+    #include <vector>               // [ C++ STL ] Vectors
+    #include <thread>               // [ C++ STL ] Threads
+    #include <mutex>                // [ C++ STL ] Mutexes
+    #include <condition_variable>   // [ C++ STL ] Condition variables
+    #include <atomic>               // [ C++ STL ] Atomic variables
+    #include <stdint.h>             // [ ANSI C ] Standard integer types
+// *****************************************************************************
+
+
+// the screen is rendered in horizontal bands of this
+// many rows; each worker thread takes one band at a time
+#define SOFTWARE_BAND_HEIGHT 8
+
+// upper limit for rendering threads (including the
+// emulation thread, which also renders bands)
+#define SOFTWARE_MAXIMUM_THREADS 8
+
+
+// =============================================================================
+//      SOFTWARE RENDERING DATA STRUCTURES
+// =============================================================================
+
+
+// textures are kept at their real size, and texels
+// outside of it are read as transparent black
+typedef struct
+{
+    std::vector< uint32_t > Texels;
+    int Width, Height;
+}
+SoftwareTexture;
+
+// -----------------------------------------------------------------------------
+
+// every draw is recorded along with the state it needs,
+// so that the whole frame can be rendered at the end
+typedef struct
+{
+    V32::GPUQuad Quad;
+    const SoftwareTexture* Texture;     // nullptr means solid color
+    uint32_t MultiplyColor;             // in framebuffer channel order
+    int32_t BlendingMode;
+    int32_t MinRow, MaxRow;             // rows that can be affected
+}
+SoftwareDrawCommand;
+
+// -----------------------------------------------------------------------------
+
+typedef struct
+{
+    unsigned Quads;
+    double RenderMilliseconds;
+}
+SoftwareStatistics;
+
+
+// =============================================================================
+//      CPU RENDERER FOR HOSTS WITHOUT A GPU
+// =============================================================================
+
+
+// implements the same video interface as VideoOutput,
+// rasterizing into a XRGB8888 frame; draws are recorded
+// during the frame and then rendered by bands in parallel
+class SoftwareRenderer
+{
+    private:
+        
+        // frame in XRGB8888 format
+        std::vector< uint32_t > Frame;
+        
+        // textures are stored in framebuffer channel order
+        // (BGRA in memory) so blending needs no swizzles
+        SoftwareTexture BiosTexture;
+        std::vector< SoftwareTexture > CartridgeTextures;
+        
+        // identical textures use the first one's texels
+        std::vector< int32_t > CartridgeTextureSources;
+        
+        // current GPU state
+        int32_t SelectedTexture;
+        uint32_t MultiplyColor;
+        int32_t BlendingMode;
+        
+        // draws recorded for the current frame
+        std::vector< SoftwareDrawCommand > Commands;
+        
+        // worker threads; each frame is a new generation,
+        // and bands are taken from a shared counter
+        std::vector< std::thread > Workers;
+        std::mutex WorkMutex;
+        std::condition_variable WorkCondition;
+        std::condition_variable DoneCondition;
+        unsigned WorkGeneration;
+        unsigned FinishedWorkers;
+        std::atomic< int > NextBand;
+        bool StopRequested;
+        bool IsInitialized;
+        
+        // metrics
+        SoftwareStatistics TotalStatistics;
+        unsigned RenderedFrames;
+        
+        // internal operations
+        void WorkerLoop();
+        void RenderBands();
+        void RenderBand( int FirstRow, int LastRow );
+        void RenderTriangle( const SoftwareDrawCommand& Command, const V32::GPUPoint* Vertices[ 3 ], int FirstRow, int LastRow );
+        const SoftwareTexture* GetTexture( int32_t GPUTextureID );
+        
+    public:
+        
+        // instance handling
+        SoftwareRenderer();
+       ~SoftwareRenderer();
+        
+        // initialization
+        void Initialize( unsigned NumberOfThreads );
+        void Destroy();
+        
+        // render functions
+        void ClearScreen( V32::GPUColor ClearColor );
+        void DrawQuad( const V32::GPUQuad& Quad );
+        void RenderFrame();
+        const uint32_t* GetFrame();
+        
+        // color and texture state
+        void SetMultiplyColor( V32::GPUColor NewMultiplyColor );
+        void SetBlendingMode( int NewBlendingMode );
+        void SelectTexture( int GPUTextureID );
+        void LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height );
+        void UnloadTexture( int GPUTextureID );
+        bool ShareTexture( int GPUTextureID, int SourceTextureID );
+        
+        // metrics
+        SoftwareStatistics GetTotalStatistics();
+        unsigned GetRenderedFrames();
+        unsigned GetNumberOfThreads();
+};
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
@@ -0,0 +1,221 @@
+// *****************************************************************************
+    // include common Vircon headers
+    #include "VirconDefinitions/Enumerations.hpp"
+    
+    // include emulator headers
+    #include "VideoCommandList.hpp"
+    #include "VideoOutput.hpp"
+    
+    // include C/C++ headers
+    #include <cstring>          // [ ANSI C ] Strings
+    #include <algorithm>        // [ C++ STL ] Algorithms
+    
+    // declare used namespaces
+    using namespace std;
+    using namespace V32;
+// *****************************************************************************
+
+
+// =============================================================================
+//      AUXILIARY FUNCTIONS FOR HASHING
+// =============================================================================
+
+
+// data is taken as 64-bit words, which is exact for all
+// recorded structures (their sizes are multiples of 8)
+static uint64_t HashData( uint64_t Hash, const void* Data, size_t Size )
+{
+    const uint8_t* Bytes = (const uint8_t*)Data;
+    
+    for( size_t i = 0; i < Size; i += 8 )
+    {
+        uint64_t Word = 0;
+        memcpy( &Word, Bytes + i, min( Size - i, (size_t)8 ) );
+        
+        Hash = (Hash ^ Word) * 0x9E3779B97F4A7C15ULL;
+        Hash ^= Hash >> 32;
+    }
+    
+    return Hash;
+}
+
+
+// =============================================================================
+//      VIDEO COMMAND LIST: INSTANCE HANDLING
+// =============================================================================
+
+
+VideoCommandList::VideoCommandList()
+{
+    // enough for most frames, to avoid
+    // reallocations while the game runs
+    Commands.reserve( 4096 );
+    Quads.reserve( 2048 );
+}
+
+
+// =============================================================================
+//      VIDEO COMMAND LIST: RECORDING
+// =============================================================================
+
+
+void VideoCommandList::ClearScreen( GPUColor ClearColor )
+{
+    VideoCommand Command;
+    Command.Type = VideoCommandTypes::ClearScreen;
+    Command.Color = ClearColor;
+    Commands.push_back( Command );
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoCommandList::DrawQuad( const GPUQuad& Quad )
+{
+    VideoCommand Command;
+    Command.Type = VideoCommandTypes::DrawQuad;
+    Command.Value = 0;
+    Commands.push_back( Command );
+    Quads.push_back( Quad );
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoCommandList::DrawRegion( const GPURegionDrawing& Drawing )
+{
+    VideoCommand Command;
+    Command.Type = VideoCommandTypes::DrawRegion;
+    Command.Value = 0;
+    Commands.push_back( Command );
+    Regions.push_back( Drawing );
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoCommandList::SetMultiplyColor( GPUColor NewMultiplyColor )
+{
+    VideoCommand Command;
+    Command.Type = VideoCommandTypes::SetMultiplyColor;
+    Command.Color = NewMultiplyColor;
+    Commands.push_back( Command );
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoCommandList::SetBlendingMode( int NewBlendingMode )
+{
+    VideoCommand Command;
+    Command.Type = VideoCommandTypes::SetBlendingMode;
+    Command.Value = NewBlendingMode;
+    Commands.push_back( Command );
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoCommandList::SelectTexture( int GPUTextureID )
+{
+    VideoCommand Command;
+    Command.Type = VideoCommandTypes::SelectTexture;
+    Command.Value = GPUTextureID;
+    Commands.push_back( Command );
+}
+
+// -----------------------------------------------------------------------------
+
+// capacity is kept for the next frame
+void VideoCommandList::Clear()
+{
+    Commands.clear();
+    Quads.clear();
+    Regions.clear();
+}
+
+
+// =============================================================================
+//      VIDEO COMMAND LIST: REPLAYING
+// =============================================================================
+
+
+void VideoCommandList::Replay( VideoOutput& Video, bool Draw )
+{
+    unsigned NextQuad = 0;
+    unsigned NextRegion = 0;
+    
+    for( const VideoCommand& Command: Commands )
+    {
+        switch( Command.Type )
+        {
+            case VideoCommandTypes::ClearScreen:
+                if( Draw )
+                  Video.ClearScreen( Command.Color );
+                
+                break;
+            
+            case VideoCommandTypes::DrawQuad:
+                if( Draw )
+                  Video.AddQuadToQueue( Quads[ NextQuad ] );
+                
+                NextQuad++;
+                break;
+            
+            case VideoCommandTypes::DrawRegion:
+                if( Draw )
+                  Video.AddRegionToQueue( Regions[ NextRegion ] );
+                
+                NextRegion++;
+                break;
+            
+            case VideoCommandTypes::SetMultiplyColor:
+                Video.SetMultiplyColor( Command.Color );
+                break;
+            
+            case VideoCommandTypes::SetBlendingMode:
+                Video.SetBlendingMode( (IOPortValues)Command.Value );
+                break;
+            
+            case VideoCommandTypes::SelectTexture:
+                Video.SelectTexture( Command.Value );
+                break;
+        }
+    }
+}
+
+
+// =============================================================================
+//      VIDEO COMMAND LIST: DUPLICATE DETECTION
+// =============================================================================
+
+
+// the render state before the first command is also
+// included: the same commands starting from a different
+// blending mode or texture can draw a different frame
+uint64_t VideoCommandList::CalculateHash( VideoOutput& Video )
+{
+    int32_t InitialState[ 4 ] =
+    {
+        Video.GetSelectedTexture(),
+        (int32_t)Video.GetBlendingMode(),
+        0,
+        (int32_t)Commands.size()
+    };
+    
+    GPUColor MultiplyColor = Video.GetMultiplyColor();
+    memcpy( &InitialState[ 2 ], &MultiplyColor, sizeof( GPUColor ) );
+    
+    uint64_t Hash = 0xCBF29CE484222325ULL;
+    Hash = HashData( Hash, InitialState, sizeof( InitialState ) );
+    Hash = HashData( Hash, Commands.data(), Commands.size() * sizeof( VideoCommand ) );
+    Hash = HashData( Hash, Quads.data(), Quads.size() * sizeof( GPUQuad ) );
+    Hash = HashData( Hash, Regions.data(), Regions.size() * sizeof( GPURegionDrawing ) );
+    return Hash;
+}
+
+
+// =============================================================================
+//      VIDEO COMMAND LIST: METRICS
+// =============================================================================
+
+
+unsigned VideoCommandList::GetNumberOfCommands()
+{
+    return Commands.size();
+}
@@ -0,0 +1,96 @@
+// *****************************************************************************
+    // start include guard
+    #ifndef VIDEOCOMMANDLIST_HPP
+    #define VIDEOCOMMANDLIST_HPP
+    
+    // include console logic headers
+    #include "ConsoleLogic/ExternalInterfaces.hpp"
+    
+    // include C/C++ headers
+    #include <vector>           // [ C++ STL ] Vectors
+    #include <stdint.h>         // [ ANSI C ] Standard integer types
+    
+    // forward declarations for all needed classes
+    class VideoOutput;
+// *****************************************************************************
+
+
+// =============================================================================
+//      RECORDED VIDEO COMMANDS
+// =============================================================================
+
+
+enum class VideoCommandTypes: int32_t
+{
+    ClearScreen = 0,
+    DrawQuad,
+    DrawRegion,
+    SetMultiplyColor,
+    SetBlendingMode,
+    SelectTexture
+};
+
+// -----------------------------------------------------------------------------
+
+// commands only keep a small value; the quads and
+// regions they draw are stored apart, in the same order
+typedef struct
+{
+    VideoCommandTypes Type;
+    
+    union
+    {
+        V32::GPUColor Color;
+        int32_t Value;
+    };
+}
+VideoCommand;
+
+
+// =============================================================================
+//      LIST OF COMMANDS FOR A FRAME
+// =============================================================================
+
+
+// records the console's video callbacks so that they
+// can be sent to the video output at a later time
+// (and from a different thread than the console's)
+class VideoCommandList
+{
+    private:
+        
+        std::vector< VideoCommand > Commands;
+        std::vector< V32::GPUQuad > Quads;
+        std::vector< V32::GPURegionDrawing > Regions;
+        
+    public:
+        
+        // instance handling
+        VideoCommandList();
+        
+        // recording
+        void ClearScreen( V32::GPUColor ClearColor );
+        void DrawQuad( const V32::GPUQuad& Quad );
+        void DrawRegion( const V32::GPURegionDrawing& Drawing );
+        void SetMultiplyColor( V32::GPUColor NewMultiplyColor );
+        void SetBlendingMode( int NewBlendingMode );
+        void SelectTexture( int GPUTextureID );
+        void Clear();
+        
+        // replaying; without drawing only render
+        // state is applied (e.g. for skipped frames)
+        void Replay( VideoOutput& Video, bool Draw );
+        
+        // the same hash means the same frame is drawn,
+        // if textures have not changed in between
+        uint64_t CalculateHash( VideoOutput& Video );
+        
+        // metrics
+        unsigned GetNumberOfCommands();
+};
+
+
+// *****************************************************************************
+    // end include guard
+    #endif
+// *****************************************************************************
@@ -9,6 +9,11 @@
     
     // include C/C++ headers
     #include <cstring>          // [ ANSI C ] Strings
+    #include <cstddef>          // [ ANSI C ] Standard definitions
+    #include <cmath>            // [ ANSI C ] Mathematics
+    #include <vector>           // [ C++ STL ] Vectors
+    #include <unordered_map>    // [ C++ STL ] Unordered maps
+    #include <algorithm>        // [ C++ STL ] Algorithms
     
     // declare used namespaces
     using namespace std;
@@ -95,6 +100,231 @@ void LogOpenGLResult( const string& EntryText )
 }
 
 
+// =============================================================================
+//      AUXILIARY FUNCTIONS FOR PIXEL DATA
+// =============================================================================
+
+
+// converts RGBA pixels to premultiplied alpha,
+// rounding each color component to nearest
+void PremultiplyAlpha( const uint8_t* Source, uint8_t* Destination, int NumberOfPixels )
+{
+    for( int i = 0; i < NumberOfPixels; i++ )
+    {
+        unsigned Alpha = Source[ 3 ];
+        Destination[ 0 ] = (Source[ 0 ] * Alpha + 127) / 255;
+        Destination[ 1 ] = (Source[ 1 ] * Alpha + 127) / 255;
+        Destination[ 2 ] = (Source[ 2 ] * Alpha + 127) / 255;
+        Destination[ 3 ] = Alpha;
+        
+        Source += 4;
+        Destination += 4;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// textures are stored at the next power of 2 size, so that
+// coordinates for 1024x1024 are scaled to it exactly; texels
+// out of the real size must read as transparent, so with no
+// clamp to border there has to be a transparent margin
+int GetTextureStorageSize( int Size )
+{
+    int StorageSize = 1;
+    
+    while( StorageSize < Size )
+      StorageSize *= 2;
+    
+    #if defined(HAVE_OPENGLES2) || defined(HAVE_OPENGLES3)
+      if( StorageSize == Size && Size < Constants::GPUTextureSize )
+        StorageSize *= 2;
+    #endif
+    
+    return StorageSize;
+}
+
+// -----------------------------------------------------------------------------
+
+// the same as clamping to edge in a full size texture,
+// where out-of-texture coordinates read the padding
+GLint GetTextureWrapMode( int StorageSize )
+{
+    #if !defined(HAVE_OPENGLES2) && !defined(HAVE_OPENGLES3)
+      if( StorageSize < Constants::GPUTextureSize )
+        return GL_CLAMP_TO_BORDER;      // default border is transparent black
+    #else
+      (void)StorageSize;
+    #endif
+    
+    return GL_CLAMP_TO_EDGE;
+}
+
+// -----------------------------------------------------------------------------
+
+// copies RGBA pixels into a larger zero-filled area, converting
+// to premultiplied alpha if needed (transparent black is kept)
+void ExpandTexturePixels( const uint8_t* Source, int Width, int Height, uint8_t* Destination, int StorageWidth, int StorageHeight, bool Premultiply )
+{
+    memset( Destination, 0, 4 * StorageWidth * StorageHeight );
+    
+    for( int y = 0; y < Height; y++ )
+    {
+        const uint8_t* SourceLine = Source + 4 * Width * y;
+        uint8_t* DestinationLine = Destination + 4 * StorageWidth * y;
+        
+        if( Premultiply )
+          PremultiplyAlpha( SourceLine, DestinationLine, Width );
+        else
+          memcpy( DestinationLine, SourceLine, 4 * Width );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// converts RGBA pixels to 8-bit indices into a palette of up
+// to 256 colors; transparent black is always index 0, so that
+// padding texels keep reading as transparent; returns false
+// (and the result is not valid) if there are more colors
+bool PalettizeTexturePixels( const uint8_t* Source, int Width, int Height, uint8_t* Indices, int StorageWidth, int StorageHeight, uint32_t* Palette )
+{
+    memset( Indices, 0, StorageWidth * StorageHeight );
+    memset( Palette, 0, 256 * sizeof( uint32_t ) );
+    
+    unordered_map< uint32_t, uint8_t > ColorIndices;
+    ColorIndices[ 0 ] = 0;
+    
+    // pixel art has long runs of the same color,
+    // so the last color found is checked first
+    uint32_t LastColor = 0;
+    uint8_t LastIndex = 0;
+    
+    for( int y = 0; y < Height; y++ )
+    {
+        uint8_t* IndicesLine = Indices + StorageWidth * y;
+        
+        for( int x = 0; x < Width; x++ )
+        {
+            uint32_t Color;
+            memcpy( &Color, Source, 4 );
+            Source += 4;
+            
+            if( Color != LastColor )
+            {
+                auto Position = ColorIndices.find( Color );
+                
+                if( Position != ColorIndices.end() )
+                  LastIndex = Position->second;
+                
+                else
+                {
+                    if( ColorIndices.size() >= 256 )
+                      return false;
+                    
+                    LastIndex = ColorIndices.size();
+                    ColorIndices[ Color ] = LastIndex;
+                    Palette[ LastIndex ] = Color;
+                }
+                
+                LastColor = Color;
+            }
+            
+            IndicesLine[ x ] = LastIndex;
+        }
+    }
+    
+    return true;
+}
+
+
+// =============================================================================
+//      AUXILIARY FUNCTIONS FOR OCCLUSION
+// =============================================================================
+
+
+// true if every point of the screen is inside the quad; its
+// vertices are top-left, top-right, bottom-left, bottom-right
+// before any transforms, so the quad is convex and its edges
+// can be followed as vertices 0, 1, 3, 2 (in any orientation)
+bool QuadCoversScreen( const GPUQuad& Quad )
+{
+    const int EdgeVertices[ 5 ] = { 0, 1, 3, 2, 0 };
+    const float ScreenCorners[ 4 ][ 2 ] =
+    {
+        { 0, 0 }, { Constants::ScreenWidth, 0 },
+        { 0, Constants::ScreenHeight }, { Constants::ScreenWidth, Constants::ScreenHeight }
+    };
+    
+    int PositiveSides = 0, NegativeSides = 0;
+    
+    for( int e = 0; e < 4; e++ )
+    {
+        const GPUPoint& Start = Quad.Vertices[ EdgeVertices[ e ] ];
+        const GPUPoint& End = Quad.Vertices[ EdgeVertices[ e + 1 ] ];
+        
+        for( int c = 0; c < 4; c++ )
+        {
+            float Side = (End.x - Start.x) * (ScreenCorners[ c ][ 1 ] - Start.y)
+                       - (End.y - Start.y) * (ScreenCorners[ c ][ 0 ] - Start.x);
+            
+            // (NaN coordinates never count as inside)
+            if( Side > 0 ) PositiveSides++;
+            else if( Side < 0 ) NegativeSides++;
+            else if( Side != 0 ) return false;
+        }
+    }
+    
+    // corners on an edge are still covered, but a
+    // degenerate quad (all sides 0) covers nothing
+    return (PositiveSides > 0 && NegativeSides == 0)
+        || (NegativeSides > 0 && PositiveSides == 0);
+}
+
+// -----------------------------------------------------------------------------
+
+// the same quad that the console would draw for a region,
+// only without the sampling corrections for zoomed regions
+// (those never make texture coordinates reach other texels)
+GPUQuad GetRegionDrawingQuad( const GPURegionDrawing& Drawing )
+{
+    float RelativeMinX = Drawing.MinX - Drawing.HotspotX;
+    float RelativeMinY = Drawing.MinY - Drawing.HotspotY;
+    float RelativeMaxX = RelativeMinX + abs( Drawing.MaxX - Drawing.MinX ) + 1;
+    float RelativeMaxY = RelativeMinY + abs( Drawing.MaxY - Drawing.MinY ) + 1;
+    
+    float TextureMinX = (Drawing.MinX + 0.5) / Constants::GPUTextureSize;
+    float TextureMinY = (Drawing.MinY + 0.5) / Constants::GPUTextureSize;
+    float TextureMaxX = (Drawing.MaxX + 0.5) / Constants::GPUTextureSize;
+    float TextureMaxY = (Drawing.MaxY + 0.5) / Constants::GPUTextureSize;
+    
+    GPUQuad Quad =
+    {
+        {
+            { RelativeMinX, RelativeMinY, TextureMinX, TextureMinY },
+            { RelativeMaxX, RelativeMinY, TextureMaxX, TextureMinY },
+            { RelativeMinX, RelativeMaxY, TextureMinX, TextureMaxY },
+            { RelativeMaxX, RelativeMaxY, TextureMaxX, TextureMaxY }
+        }
+    };
+    
+    float AngleCos = cos( Drawing.DrawingAngle );
+    float AngleSin = sin( Drawing.DrawingAngle );
+    
+    for( int v = 0; v < 4; v++ )
+    {
+        float ScaledX = Quad.Vertices[ v ].x * Drawing.DrawingScaleX;
+        float ScaledY = Quad.Vertices[ v ].y * Drawing.DrawingScaleY;
+        
+        Quad.Vertices[ v ].x = ScaledX * AngleCos - ScaledY * AngleSin + Drawing.DrawingPointX;
+        Quad.Vertices[ v ].y = ScaledX * AngleSin + ScaledY * AngleCos + Drawing.DrawingPointY;
+        
+        if( Drawing.DrawingScaleX < 0 ) Quad.Vertices[ v ].x += 1;
+        if( Drawing.DrawingScaleY < 0 ) Quad.Vertices[ v ].y += 1;
+    }
+    
+    return Quad;
+}
+
+
 // =============================================================================
 //      GLSL CODE FOR SHADERS
 // =============================================================================
@@ -104,39 +334,203 @@ const string VertexShaderCode =
     "#version 100                                                                               \n"
     "                                                                                           \n"
     "attribute vec4 VertexInfo;                                                                 \n"
+    "attribute vec4 VertexColor;                                                                \n"
+    "uniform vec2 PositionOffset;                                                               \n"
+    "uniform vec2 TextureScale;                                                                 \n"
     "varying highp vec2 TextureCoordinate;                                                      \n"
+    "varying mediump vec4 MultiplyColor;                                                        \n"
     "                                                                                           \n"
     "void main()                                                                                \n"
     "{                                                                                          \n"
     "    // (1) first convert coordinates to the standard OpenGL screen space                   \n"
     "                                                                                           \n"
+    "    // retained batches are drawn again at a different position                            \n"
+    "    vec2 Position = VertexInfo.xy + PositionOffset;                                        \n"
+    "                                                                                           \n"
     "    // x is transformed from (0.0,640.0) to (-1.0,+1.0)                                    \n"
-    "    gl_Position.x = (VertexInfo.x / (640.0/2.0)) - 1.0;                                    \n"
+    "    gl_Position.x = (Position.x / (640.0/2.0)) - 1.0;                                      \n"
     "                                                                                           \n"
     "    // y is transformed from (0.0,360.0) to (+1.0,-1.0), so it undoes its inversion        \n"
-    "    gl_Position.y = 1.0 - (VertexInfo.y / (360.0/2.0));                                    \n"
+    "    gl_Position.y = 1.0 - (Position.y / (360.0/2.0));                                      \n"
     "                                                                                           \n"
     "    // even in 2D we may also need to set z and w                                          \n"
     "    gl_Position.z = 0.0;                                                                   \n"
     "    gl_Position.w = 1.0;                                                                   \n"
     "                                                                                           \n"
-    "    // (2) now texture coordinate is just provided as is to the fragment shader            \n"
-    "    // (it is only needed here because fragment shaders cannot take inputs directly)       \n"
-    "    TextureCoordinate = VertexInfo.zw;                                                     \n"
+    "    // (2) texture coordinate is given to the fragment shader, scaled to the size          \n"
+    "    // the texture is stored with (coordinates in vertices are for a 1024x1024 size)       \n"
+    "    TextureCoordinate = VertexInfo.zw * TextureScale;                                      \n"
+    "                                                                                           \n"
+    "    // (3) multiply color is also given per vertex, so that it can change within a batch   \n"
+    "    MultiplyColor = VertexColor;                                                           \n"
     "}                                                                                          \n";
 
 const string FragmentShaderCode =
     "#version 100                                                                    \n"
     "                                                                                \n"
-    "uniform mediump vec4 MultiplyColor;                                             \n"
     "uniform sampler2D TextureUnit;                                                  \n"
     "varying highp vec2 TextureCoordinate;                                           \n"
+    "varying mediump vec4 MultiplyColor;                                             \n"
     "                                                                                \n"
     "void main()                                                                     \n"
     "{                                                                               \n"
     "    gl_FragColor = MultiplyColor * texture2D( TextureUnit, TextureCoordinate ); \n"
     "}                                                                               \n";
 
+// the palette lookup is kept in a separate shader, so
+// that it costs nothing when palettes are not used
+const string PaletteFragmentShaderCode =
+    "#version 100                                                                    \n"
+    "                                                                                \n"
+    "uniform sampler2D TextureUnit;                                                  \n"
+    "uniform sampler2D PaletteUnit;                                                  \n"
+    "uniform bool UsePalette;                                                        \n"
+    "varying highp vec2 TextureCoordinate;                                           \n"
+    "varying mediump vec4 MultiplyColor;                                             \n"
+    "                                                                                \n"
+    "void main()                                                                     \n"
+    "{                                                                               \n"
+    "    mediump vec4 TextureColor = texture2D( TextureUnit, TextureCoordinate );    \n"
+    "                                                                                \n"
+    "    // palettized textures store a color index in red                           \n"
+    "    if( UsePalette )                                                            \n"
+    "    {                                                                           \n"
+    "        mediump float PalettePosition = (TextureColor.r * 255.0 + 0.5) / 256.0; \n"
+    "        TextureColor = texture2D( PaletteUnit, vec2( PalettePosition, 0.5 ) );  \n"
+    "    }                                                                           \n"
+    "                                                                                \n"
+    "    gl_FragColor = MultiplyColor * TextureColor;                                \n"
+    "}                                                                               \n";
+
+
+// -----------------------------------------------------------------------------
+
+// texture arrays need GLSL 1.30 or GLSL ES 3.00
+#if defined(HAVE_OPENGLES3)
+  #define TEXTURE_ARRAY_GLSL_VERSION "#version 300 es                                                 \n"
+#else
+  #define TEXTURE_ARRAY_GLSL_VERSION "#version 130                                                    \n"
+#endif
+
+const string ArrayVertexShaderCode =
+    TEXTURE_ARRAY_GLSL_VERSION
+    "                                                                                \n"
+    "in vec4 VertexInfo;                                                             \n"
+    "in vec4 VertexColor;                                                            \n"
+    "in float VertexLayer;                                                           \n"
+    "uniform vec2 PositionOffset;                                                    \n"
+    "uniform vec2 TextureScale;                                                      \n"
+    "out highp vec3 TextureCoordinate;                                               \n"
+    "out mediump vec4 MultiplyColor;                                                 \n"
+    "                                                                                \n"
+    "void main()                                                                     \n"
+    "{                                                                               \n"
+    "    // same screen space transformation as the regular shader                   \n"
+    "    vec2 Position = VertexInfo.xy + PositionOffset;                             \n"
+    "    gl_Position.x = (Position.x / (640.0/2.0)) - 1.0;                           \n"
+    "    gl_Position.y = 1.0 - (Position.y / (360.0/2.0));                           \n"
+    "    gl_Position.z = 0.0;                                                        \n"
+    "    gl_Position.w = 1.0;                                                        \n"
+    "                                                                                \n"
+    "    // texture layer is passed as a third texture coordinate                    \n"
+    "    TextureCoordinate = vec3( VertexInfo.zw * TextureScale, VertexLayer );      \n"
+    "    MultiplyColor = VertexColor;                                                \n"
+    "}                                                                               \n";
+
+const string ArrayFragmentShaderCode =
+    TEXTURE_ARRAY_GLSL_VERSION
+    "                                                                                \n"
+    "precision mediump float;                                                        \n"
+    "uniform mediump sampler2DArray TextureUnit;                                     \n"
+    "in highp vec3 TextureCoordinate;                                                \n"
+    "in mediump vec4 MultiplyColor;                                                  \n"
+    "out mediump vec4 FragmentColor;                                                 \n"
+    "                                                                                \n"
+    "void main()                                                                     \n"
+    "{                                                                               \n"
+    "    // negative layers are used to draw solid colors                            \n"
+    "    if( TextureCoordinate.z < 0.0 )                                             \n"
+    "      FragmentColor = MultiplyColor;                                            \n"
+    "    else                                                                        \n"
+    "      FragmentColor = MultiplyColor * texture( TextureUnit, TextureCoordinate );\n"
+    "}                                                                               \n";
+
+// -----------------------------------------------------------------------------
+
+// for instanced rendering, the vertex shader builds each
+// region quad by itself, replicating V32GPU::DrawRegion
+const string InstancedVertexShaderCode =
+    TEXTURE_ARRAY_GLSL_VERSION
+    "                                                                                                             \n"
+    "uniform highp isampler2DArray RegionTable;                                                                   \n"
+    "in vec2 InstancePoint;                                                                                       \n"
+    "in vec4 InstanceTransform;                                                                                   \n"
+    "in ivec2 InstanceRegion;                                                                                     \n"
+    "in vec4 InstanceColor;                                                                                       \n"
+    "uniform vec2 TextureScale;                                                                                   \n"
+    "out highp vec3 TextureCoordinate;                                                                            \n"
+    "out mediump vec4 MultiplyColor;                                                                              \n"
+    "                                                                                                             \n"
+    "void main()                                                                                                  \n"
+    "{                                                                                                            \n"
+    "    // each instance is drawn as a 4 vertex strip                                                            \n"
+    "    bvec2 IsMaxCorner = bvec2( (gl_VertexID & 1) != 0, (gl_VertexID & 2) != 0 );                             \n"
+    "    MultiplyColor = InstanceColor;                                                                           \n"
+    "    vec2 Position;                                                                                           \n"
+    "                                                                                                             \n"
+    "    // negative regions are full screen quads of solid color                                                 \n"
+    "    if( InstanceRegion.x < 0 )                                                                               \n"
+    "    {                                                                                                        \n"
+    "        Position = mix( vec2( 0.0 ), vec2( 640.0, 360.0 ), IsMaxCorner );                                    \n"
+    "        TextureCoordinate = vec3( 0.0, 0.0, -1.0 );                                                          \n"
+    "    }                                                                                                        \n"
+    "                                                                                                             \n"
+    "    else                                                                                                     \n"
+    "    {                                                                                                        \n"
+    "        // read region bounds and hotspot from the table                                                     \n"
+    "        ivec3 TablePosition = ivec3( (InstanceRegion.x % 64) * 2, InstanceRegion.x / 64, InstanceRegion.y ); \n"
+    "        ivec4 Bounds = texelFetch( RegionTable, TablePosition, 0 );                                          \n"
+    "        ivec2 Hotspot = texelFetch( RegionTable, TablePosition + ivec3( 1, 0, 0 ), 0 ).xy;                   \n"
+    "        ivec2 RegionSize = abs( Bounds.zw - Bounds.xy ) + 1;                                                 \n"
+    "        vec2 Scale = InstanceTransform.xy;                                                                   \n"
+    "                                                                                                             \n"
+    "        // pixel-centered texture coordinates, corrected for                                                 \n"
+    "        // large scalings as done by the console GPU                                                         \n"
+    "        vec2 TextureMin = vec2( Bounds.xy ) + 0.5;                                                           \n"
+    "        vec2 TextureMax = vec2( Bounds.zw ) + 0.5;                                                           \n"
+    "        vec2 Correction = 0.5 - 1.0 / (2.0 * abs( Scale ));                                                  \n"
+    "        Correction = mix( vec2( 0.0 ), Correction, greaterThan( abs( Scale ), vec2( 1.0 ) ) );               \n"
+    "        Correction *= mix( vec2( -1.0 ), vec2( 1.0 ), lessThan( TextureMin, TextureMax ) );                  \n"
+    "        TextureMin -= Correction;                                                                            \n"
+    "        TextureMax += Correction;                                                                            \n"
+    "                                                                                                             \n"
+    "        vec2 TexturePosition = mix( TextureMin, TextureMax, IsMaxCorner );                                   \n"
+    "        TextureCoordinate = vec3( TexturePosition / 1024.0 * TextureScale, float( InstanceRegion.y ) );      \n"
+    "                                                                                                             \n"
+    "        // position relative to the hotspot, then apply                                                      \n"
+    "        // scaling, rotation and translation in that order                                                   \n"
+    "        vec2 RelativeMin = vec2( Bounds.xy - Hotspot );                                                      \n"
+    "        vec2 RelativeMax = vec2( Bounds.xy - Hotspot + RegionSize );                                         \n"
+    "        Position = mix( RelativeMin, RelativeMax, IsMaxCorner ) * Scale;                                     \n"
+    "                                                                                                             \n"
+    "        float AngleCos = InstanceTransform.z;                                                                \n"
+    "        float AngleSin = InstanceTransform.w;                                                                \n"
+    "        Position = vec2( Position.x * AngleCos - Position.y * AngleSin,                                      \n"
+    "                         Position.x * AngleSin + Position.y * AngleCos );                                    \n"
+    "                                                                                                             \n"
+    "        Position += InstancePoint;                                                                           \n"
+    "                                                                                                             \n"
+    "        // negative scaling displaces images by 1 pixel                                                      \n"
+    "        Position += vec2( lessThan( Scale, vec2( 0.0 ) ) );                                                  \n"
+    "    }                                                                                                        \n"
+    "                                                                                                             \n"
+    "    // same screen space transformation as the regular shader                                                \n"
+    "    gl_Position.x = (Position.x / (640.0/2.0)) - 1.0;                                                        \n"
+    "    gl_Position.y = 1.0 - (Position.y / (360.0/2.0));                                                        \n"
+    "    gl_Position.z = 0.0;                                                                                     \n"
+    "    gl_Position.w = 1.0;                                                                                     \n"
+    "}                                                                                                            \n";
+
 
 // =============================================================================
 //      VIDEO OUTPUT: INSTANCE HANDLING
@@ -147,14 +541,97 @@ VideoOutput::VideoOutput()
 {
     // default values
     SelectedTexture = -1;
+    MultiplyColor = GPUColor{ 255, 255, 255, 255 };
+    VertexColor = MultiplyColor;
+    BlendingMode = IOPortValues::GPUBlendingMode_Alpha;
+    AppliedBlendingMode = BlendingMode;
+    UsePremultipliedAlpha = false;
     QueuedQuads = 0;
+    StreamOffset = 0;
+    
+    // no metrics yet
+    memset( &FrameStatistics, 0, sizeof( VideoStatistics ) );
+    memset( &LastFrameStatistics, 0, sizeof( VideoStatistics ) );
+    memset( &TotalStatistics, 0, sizeof( VideoStatistics ) );
+    memset( &TextureMemory, 0, sizeof( TextureMemoryStatistics ) );
+    RenderedFrames = 0;
     
     // all texture IDs are initially 0
     BiosTextureID = 0;
     WhiteTextureID = 0;
+    BoundTextureID = 0;
+    
+    for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+    {
+        CartridgeTextureIDs[ i ] = 0;
+        CartridgeTextureSources[ i ] = i;
+    }
+    
+    // no textures have been loaded yet
+    BiosTextureCopy.Width = BiosTextureCopy.Height = 0;
+    CartridgeTextureCopies.resize( Constants::GPUMaximumCartridgeTextures );
+    ReservedCartridgeTextures = 0;
+    
+    // texture coordinates are not scaled until
+    // textures are loaded with their real sizes
+    BiosTextureScale[ 0 ] = BiosTextureScale[ 1 ] = 1;
+    AppliedTextureScale[ 0 ] = AppliedTextureScale[ 1 ] = 1;
+    
+    for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+      CartridgeTextureScales[ i ][ 0 ] = CartridgeTextureScales[ i ][ 1 ] = 1;
+    
+    // without a memory budget all textures stay in the GPU
+    TextureMemoryBudget = 0;
+    ResidentTextureBytes = 0;
     
     for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
-      CartridgeTextureIDs[ i ] = 0;
+      CartridgeTextureLastUse[ i ] = 0;
+    
+    // no texture has opaque areas until loaded
+    memset( &BiosTextureOpacity, 0, sizeof( TextureOpacityMap ) );
+    CartridgeTextureOpacity.resize( Constants::GPUMaximumCartridgeTextures );
+    memset( CartridgeTextureOpacity.data(), 0, CartridgeTextureOpacity.size() * sizeof( TextureOpacityMap ) );
+    ClearPending = false;
+    
+    // nothing is drawn outside of frames
+    UseFramebufferInvalidation = false;
+    FrameDrawingStarted = true;
+    FrameCovered = false;
+    FrameReplacedScreen = false;
+    CheckErrors = false;
+    
+    // palettes are only used when requested
+    UsePalettes = false;
+    BiosPaletteID = 0;
+    AppliedPaletteID = 0;
+    
+    for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+      CartridgePaletteIDs[ i ] = 0;
+    
+    // texture arrays are only used when requested
+    UseTextureArray = false;
+    TextureArrayID = 0;
+    TextureArrayLayers = 0;
+    TextureArrayWidth = TextureArrayHeight = 0;
+    SelectedLayer = 0;
+    ValuesPerVertex = 5;
+    
+    // instanced rendering is also optional
+    UseInstancing = false;
+    RegionTablesChanged = false;
+    RegionTableID = 0;
+    
+    // and so are retained batches
+    UseRetainedBatches = false;
+    NextRetainedBatch = 0;
+    PositionOffsetX = PositionOffsetY = 0;
+    StreamAttributesChanged = false;
+    
+    for( RetainedBatch& Batch: RetainedBatches )
+    {
+        Batch.VBO = 0;
+        Batch.Quads = 0;
+    }
     
     // all OpenGL IDs are initially 0
     VAO = 0;
@@ -203,7 +680,13 @@ bool VideoOutput::CompileShaderProgram()
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // PART 1: Compile our vertex shader
     VertexShaderID = glCreateShader( GL_VERTEX_SHADER );
-    const char *VertexShaderPointer = VertexShaderCode.c_str();
+    const string& VertexShaderCodeUsed =
+    (
+        UseInstancing? InstancedVertexShaderCode :
+        UseTextureArray? ArrayVertexShaderCode : VertexShaderCode
+    );
+    
+    const char *VertexShaderPointer = VertexShaderCodeUsed.c_str();
     glShaderSource( VertexShaderID, 1, &VertexShaderPointer, nullptr );
     glCompileShader( VertexShaderID );
     glGetShaderiv( VertexShaderID, GL_COMPILE_STATUS, &Success );
@@ -229,7 +712,13 @@ bool VideoOutput::CompileShaderProgram()
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // PART 2: Compile our fragment shader
     FragmentShaderID = glCreateShader( GL_FRAGMENT_SHADER );
-    const char *FragmentShaderPointer = FragmentShaderCode.c_str();
+    const string& FragmentShaderCodeUsed =
+    (
+        UseTextureArray? ArrayFragmentShaderCode :
+        UsePalettes? PaletteFragmentShaderCode : FragmentShaderCode
+    );
+    
+    const char *FragmentShaderPointer = FragmentShaderCodeUsed.c_str();
     glShaderSource( FragmentShaderID, 1, &FragmentShaderPointer, nullptr );
     glCompileShader( FragmentShaderID );
     glGetShaderiv( FragmentShaderID, GL_COMPILE_STATUS, &Success );
@@ -291,6 +780,88 @@ bool VideoOutput::CompileShaderProgram()
 
 // -----------------------------------------------------------------------------
 
+// this needs to be set before initializing, since
+// it determines the shaders and vertex format to use
+void VideoOutput::SetTextureArrayMode( bool Enabled )
+{
+    if( IsInitialized )
+      return;
+    
+    #if defined(HAVE_OPENGLES2)
+      if( Enabled )
+        LOG( "Texture arrays are not supported on OpenGL ES 2" );
+      
+      UseTextureArray = false;
+    #else
+      UseTextureArray = Enabled;
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+// this needs to be set before initializing, since
+// textures are converted when they are loaded
+void VideoOutput::SetPremultipliedAlphaMode( bool Enabled )
+{
+    if( IsInitialized )
+      return;
+    
+    UsePremultipliedAlpha = Enabled;
+}
+
+// -----------------------------------------------------------------------------
+
+// this needs to be set before initializing; instanced
+// rendering is built on top of the texture array mode
+void VideoOutput::SetInstancingMode( bool Enabled )
+{
+    if( IsInitialized )
+      return;
+    
+    #if defined(HAVE_OPENGLES2)
+      if( Enabled )
+        LOG( "Instanced rendering is not supported on OpenGL ES 2" );
+      
+      UseInstancing = false;
+    #else
+      UseInstancing = Enabled;
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+bool VideoOutput::IsInstancingEnabled()
+{
+    return UseInstancing;
+}
+
+// -----------------------------------------------------------------------------
+
+// this needs to be set before initializing; it does
+// not apply to instanced rendering, where batches
+// are already much smaller than the vertices
+void VideoOutput::SetRetainedBatchMode( bool Enabled )
+{
+    if( IsInitialized )
+      return;
+    
+    UseRetainedBatches = Enabled;
+}
+
+// -----------------------------------------------------------------------------
+
+// this needs to be set before initializing, since
+// textures are converted when they are loaded
+void VideoOutput::SetPaletteMode( bool Enabled )
+{
+    if( IsInitialized )
+      return;
+    
+    UsePalettes = Enabled;
+}
+
+// -----------------------------------------------------------------------------
+
 void VideoOutput::InitRendering()
 {
     LOG( "Initializing rendering" );
@@ -302,6 +873,73 @@ void VideoOutput::InitRendering()
     LOG( string("Renderer: ") + (char*)glGetString( GL_RENDERER ) );
     LOG( string("GLSL version: ") + (char*)glGetString( GL_SHADING_LANGUAGE_VERSION ) );
     
+    // instanced draws need GL 3.1 in desktop profiles
+    #if !defined(HAVE_OPENGLES2) && !defined(HAVE_OPENGLES3)
+      if( UseInstancing && (!glDrawArraysInstanced || !glVertexAttribDivisor || !glVertexAttribIPointer) )
+      {
+          LOG( "Instanced rendering disabled: not supported by the OpenGL context" );
+          UseInstancing = false;
+      }
+    #endif
+    
+    if( UseInstancing )
+      UseTextureArray = true;
+    
+    // texture array mode needs a layer for every
+    // texture (this is guaranteed in GL3 and GLES3
+    // only up to 256 layers, so check it here)
+    #if !defined(HAVE_OPENGLES2)
+      if( UseTextureArray )
+      {
+          GLint MaximumLayers = 0;
+          glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &MaximumLayers );
+          LOG( "Maximum texture array layers: " + to_string( MaximumLayers ) );
+          
+          if( MaximumLayers < Constants::GPUMaximumCartridgeTextures + 1 )
+          {
+              LOG( "Texture array mode disabled: not enough layers" );
+              UseTextureArray = false;
+          }
+      }
+    #endif
+    
+    if( !UseTextureArray )
+      UseInstancing = false;
+    
+    if( UseInstancing )
+      UseRetainedBatches = false;
+    
+    // all layers of a texture array have the same format,
+    // and they are kept as a single GL object
+    if( UseTextureArray )
+    {
+        UsePalettes = false;
+        TextureMemoryBudget = 0;
+    }
+    
+    ValuesPerVertex = (UseTextureArray? 6 : 5);
+    LOG( string("Texture array mode is ") + (UseTextureArray? "enabled" : "disabled") );
+    LOG( string("Instanced rendering is ") + (UseInstancing? "enabled" : "disabled") );
+    LOG( string("Retained batch mode is ") + (UseRetainedBatches? "enabled" : "disabled") );
+    LOG( string("Palette mode is ") + (UsePalettes? "enabled" : "disabled") );
+    
+    // framebuffer invalidation is core in GL 4.3 and GLES3
+    #if defined(HAVE_OPENGLES2)
+      const char* Extensions = (const char*)glGetString( GL_EXTENSIONS );
+      UseFramebufferInvalidation = (Extensions && strstr( Extensions, "GL_EXT_discard_framebuffer" ) && glDiscardFramebufferEXT);
+    #elif defined(HAVE_OPENGLES3)
+      UseFramebufferInvalidation = true;
+    #else
+      UseFramebufferInvalidation = (glInvalidateFramebuffer != nullptr);
+    #endif
+    
+    LOG( string("Framebuffer invalidation is ") + (UseFramebufferInvalidation? "supported" : "not supported") );
+    
+    if( TextureMemoryBudget )
+      LOG( "Texture memory budget is " + to_string( TextureMemoryBudget / (1024 * 1024) ) + " MB" );
+    else
+      LOG( "Texture memory budget is disabled" );
+    
     // compile our shader program
     LOG( "Compiling GLSL shader program" );
     ClearOpenGLErrors();
@@ -314,11 +952,38 @@ void VideoOutput::InitRendering()
     
     // find the position for all our input variables within the shader program
     LOG( "Finding variables in shader program" );
-    VertexInfoLocation = glGetAttribLocation( ShaderProgramID, "VertexInfo" );
+    
+    if( UseInstancing )
+    {
+        InstancePointLocation = glGetAttribLocation( ShaderProgramID, "InstancePoint" );
+        InstanceTransformLocation = glGetAttribLocation( ShaderProgramID, "InstanceTransform" );
+        InstanceRegionLocation = glGetAttribLocation( ShaderProgramID, "InstanceRegion" );
+        InstanceColorLocation = glGetAttribLocation( ShaderProgramID, "InstanceColor" );
+    }
+    
+    else
+    {
+        VertexInfoLocation = glGetAttribLocation( ShaderProgramID, "VertexInfo" );
+        VertexColorLocation = glGetAttribLocation( ShaderProgramID, "VertexColor" );
+        
+        if( UseTextureArray )
+          VertexLayerLocation = glGetAttribLocation( ShaderProgramID, "VertexLayer" );
+    }
     
     // find the position for all our input uniforms within the shader program
     TextureUnitLocation = glGetUniformLocation( ShaderProgramID, "TextureUnit" );
-    MultiplyColorLocation = glGetUniformLocation( ShaderProgramID, "MultiplyColor" );
+    TextureScaleLocation = glGetUniformLocation( ShaderProgramID, "TextureScale" );
+    
+    if( UsePalettes )
+    {
+        PaletteUnitLocation = glGetUniformLocation( ShaderProgramID, "PaletteUnit" );
+        UsePaletteLocation = glGetUniformLocation( ShaderProgramID, "UsePalette" );
+    }
+    
+    if( UseInstancing )
+      RegionTableLocation = glGetUniformLocation( ShaderProgramID, "RegionTable" );
+    else
+      PositionOffsetLocation = glGetUniformLocation( ShaderProgramID, "PositionOffset" );
     
     LOG( "Creating vertex arrays and buffers" );
     
@@ -338,45 +1003,71 @@ void VideoOutput::InitRendering()
     glGenBuffers( 1, &VBOVertexInfo );
     glGenBuffers( 1, &VBOIndices );
     
+    // retained batches have their own buffers
+    // (their storage is allocated when used)
+    if( UseRetainedBatches )
+      for( RetainedBatch& Batch: RetainedBatches )
+      {
+          glGenBuffers( 1, &Batch.VBO );
+          Batch.Quads = 0;
+      }
+    
     // bind our textures to GPU's texture unit 0
     glActiveTexture( GL_TEXTURE0 );
-    glBindTexture( GL_TEXTURE_2D, 0 );      // set no texture until we load one
+    BindTexture( 0 );                       // set no texture until we load one
     glEnable( GL_TEXTURE_2D );
     
+    // textures are counted again for the new context
+    memset( &TextureMemory, 0, sizeof( TextureMemoryStatistics ) );
+    ResidentTextureBytes = 0;
+    
+    // with a budget, cartridge textures are kept here
+    if( TextureMemoryBudget )
+      CartridgeTextureData.resize( Constants::GPUMaximumCartridgeTextures );
+    
+    // in texture array mode, start with only the BIOS
+    // layer; the array grows as larger textures are loaded
+    if( UseTextureArray )
+    {
+        int MinimumSize = GetTextureStorageSize( 1 );
+        ResizeTextureArray( 1, 0, MinimumSize, MinimumSize );
+    }
+    
     // initialize our multiply color to neutral
     SetMultiplyColor( GPUColor{ 255, 255, 255, 255 } );
     
     // initialize blending
     glEnable( GL_BLEND );
-    SetBlendingMode( IOPortValues::GPUBlendingMode_Alpha );
+    BlendingMode = IOPortValues::GPUBlendingMode_Alpha;
+    ApplyBlendingMode();
+    LOG( string("Premultiplied alpha mode is ") + (UsePremultipliedAlpha? "enabled" : "disabled") );
     
     // create a white texture to draw solid color
     CreateWhiteTexture();
     
-    // allocate memory for vertex info in the GPU
+    // allocate memory for vertex info in the GPU; except
+    // for GLES 2, this is a stream where batches are placed
+    // one after another (see RenderQuadQueue)
     LOG( "Initializing vertex info buffer" );
     glBindBuffer( GL_ARRAY_BUFFER, VBOVertexInfo );
+    StreamOffset = 0;
+    
+    #if defined(HAVE_OPENGLES2)
+      GLsizeiptr VertexBufferSize = sizeof( QuadVerticesInfo );
+    #else
+      GLsizeiptr VertexBufferSize = QUAD_STREAM_SIZE * 4 * ValuesPerVertex * sizeof( GLfloat );
+    #endif
     
     glBufferData
     (
         GL_ARRAY_BUFFER,
-        sizeof( QuadVerticesInfo ),
-        QuadVerticesInfo,
+        VertexBufferSize,
+        nullptr,
         GL_STREAM_DRAW
     );
     
     // define format for vertex info
-    glVertexAttribPointer
-    (
-        VertexInfoLocation, // location (0-based index) within the shader program
-        4,                  // 4 components per vertex (x,y,tex_x,tex_y)
-        GL_FLOAT,           // each component is of type GLfloat
-        GL_FALSE,           // do not normalize values (convert directly to fixed-point)
-        0,                  // no gap between values (adjacent in memory)
-        (void*)0            // starts at offset 0
-    );
-    
-    glEnableVertexAttribArray( VertexInfoLocation );    
+    SetVertexAttributes( 0 );
     
     // allocate memory for vertex indices in the GPU
     // (vertices are given as triangle strip pairs)
@@ -391,27 +1082,148 @@ void VideoOutput::InitRendering()
         GL_STATIC_DRAW
     );
     
+    FrameStatistics.VertexBytes += QUAD_QUEUE_SIZE * 6 * sizeof( GLushort );
+    TotalStatistics.VertexBytes += QUAD_QUEUE_SIZE * 6 * sizeof( GLushort );
+    
+    // textures loaded before this context was
+    // available can be used as soon as it is
+    RecreateTextures();
+    
     LOG( "Finished initializing rendering" );
     IsInitialized = true;
 }
 
 // -----------------------------------------------------------------------------
 
-void VideoOutput::CreateWhiteTexture()
+// vertex format depends on texture array mode;
+// offset is given in bytes within the vertex buffer
+void VideoOutput::SetVertexAttributes( GLintptr Offset )
 {
-    LOG( "Creating white texture" );
-    ClearOpenGLErrors();
+    // instances advance once per quad, not per vertex
+    #if !defined(HAVE_OPENGLES2)
+      if( UseInstancing )
+      {
+          GLsizei InstanceStride = sizeof( RegionInstance );
+          
+          glVertexAttribPointer
+          (
+              InstancePointLocation,
+              2,
+              GL_SHORT,
+              GL_FALSE,
+              InstanceStride,
+              (void*)(Offset + offsetof( RegionInstance, DrawingPointX ))
+          );
+          
+          // scale x,y and rotation as cos,sin
+          glVertexAttribPointer
+          (
+              InstanceTransformLocation,
+              4,
+              GL_FLOAT,
+              GL_FALSE,
+              InstanceStride,
+              (void*)(Offset + offsetof( RegionInstance, DrawingScaleX ))
+          );
+          
+          // region and layer are read as integers
+          glVertexAttribIPointer
+          (
+              InstanceRegionLocation,
+              2,
+              GL_SHORT,
+              InstanceStride,
+              (void*)(Offset + offsetof( RegionInstance, RegionID ))
+          );
+          
+          glVertexAttribPointer
+          (
+              InstanceColorLocation,
+              4,
+              GL_UNSIGNED_BYTE,
+              GL_TRUE,
+              InstanceStride,
+              (void*)(Offset + offsetof( RegionInstance, Color ))
+          );
+          
+          GLuint InstanceLocations[ 4 ] =
+          {
+              InstancePointLocation, InstanceTransformLocation,
+              InstanceRegionLocation, InstanceColorLocation
+          };
+          
+          for( GLuint Location: InstanceLocations )
+          {
+              glVertexAttribDivisor( Location, 1 );
+              glEnableVertexAttribArray( Location );
+          }
+          
+          return;
+      }
+    #endif
     
-    // create new texture ID
-    glGenTextures( 1, &WhiteTextureID );
-    glBindTexture( GL_TEXTURE_2D, WhiteTextureID );
+    GLsizei Stride = ValuesPerVertex * sizeof( GLfloat );
     
-    // create our texture from 1 single white pixel
-    uint8_t WhitePixel[ 4 ] = { 255, 255, 255, 255 };
+    glVertexAttribPointer
+    (
+        VertexInfoLocation, // location (0-based index) within the shader program
+        4,                  // 4 components per vertex (x,y,tex_x,tex_y)
+        GL_FLOAT,           // each component is of type GLfloat
+        GL_FALSE,           // do not normalize values (convert directly to fixed-point)
+        Stride,             // distance between consecutive vertices
+        (void*)Offset       // starts at the given offset
+    );
     
-    glTexImage2D
+    glEnableVertexAttribArray( VertexInfoLocation );
+    
+    // multiply color is given as 4 bytes, that
+    // are converted to the range [0.0-1.0]
+    glVertexAttribPointer
     (
-        GL_TEXTURE_2D,
+        VertexColorLocation,
+        4,
+        GL_UNSIGNED_BYTE,
+        GL_TRUE,
+        Stride,
+        (void*)(Offset + 4 * sizeof( GLfloat ))
+    );
+    
+    glEnableVertexAttribArray( VertexColorLocation );
+    
+    // texture layer is placed after the other components
+    if( UseTextureArray )
+    {
+        glVertexAttribPointer
+        (
+            VertexLayerLocation,
+            1,
+            GL_FLOAT,
+            GL_FALSE,
+            Stride,
+            (void*)(Offset + 5 * sizeof( GLfloat ))
+        );
+        
+        glEnableVertexAttribArray( VertexLayerLocation );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::CreateWhiteTexture()
+{
+    LOG( "Creating white texture" );
+    ClearOpenGLErrors();
+    
+    // create new texture ID
+    glGenTextures( 1, &WhiteTextureID );
+    BindTexture( WhiteTextureID );
+    
+    // create our texture from 1 single white pixel
+    uint8_t WhitePixel[ 4 ] = { 255, 255, 255, 255 };
+    
+    glTexImage2D
+    (
+        GL_TEXTURE_2D,
         0,
         GL_RGBA,
         1, 1,       // width, height
@@ -444,6 +1256,10 @@ void VideoOutput::ReleaseTexture( GLuint& OpenGLTextureID )
     {
         LOG( "Releasing OpenGL texture with ID = " + to_string(OpenGLTextureID) );
         glDeleteTextures( 1, &OpenGLTextureID );
+        
+        // deleting a bound texture unbinds it
+        if( OpenGLTextureID == BoundTextureID )
+          BoundTextureID = 0;
     }
     
     OpenGLTextureID = 0;
@@ -462,9 +1278,16 @@ void VideoOutput::Destroy()
     // release all textures
     LOG( "Releasing all textures" );
     ReleaseTexture( WhiteTextureID );
-    
+    ReleaseTexture( TextureArrayID );
+    ReleaseTexture( RegionTableID );
+    TextureArrayLayers = 0;
+    TextureArrayWidth = TextureArrayHeight = 0;
+    RegionTables.clear();
+    
+    // (their copies are kept, to create them again if
+    // rendering is initialized for a new context)
     for( int i = -1; i < Constants::GPUMaximumCartridgeTextures; i++ )
-      UnloadTexture( i );
+      ReleaseTextureObjects( i );
     
     // delete our buffers
     LOG( "Deleting OpenGL vertex buffers" );
@@ -472,6 +1295,16 @@ void VideoOutput::Destroy()
     glDeleteBuffers( 1, &VBOIndices );
     VBOVertexInfo = VBOIndices = 0;
     
+    for( RetainedBatch& Batch: RetainedBatches )
+    {
+        if( Batch.VBO )
+          glDeleteBuffers( 1, &Batch.VBO );
+        
+        Batch.VBO = 0;
+        Batch.Quads = 0;
+        Batch.Vertices.clear();
+    }
+    
     LOG( "Destroying OpenGL vertex arrays" );
     #if defined(EMUELEC) || defined(HAVE_OPENGLES2)
       glDeleteVertexArraysOES( 1, &VAO );
@@ -485,6 +1318,11 @@ void VideoOutput::Destroy()
     glDeleteProgram( ShaderProgramID );
     ShaderProgramID = 0;
     
+    // nothing queued can be drawn without the context
+    QueuedQuads = 0;
+    ClearPending = false;
+    FrameDrawingStarted = true;
+    
     IsInitialized = false;
 }
 
@@ -507,42 +1345,155 @@ void VideoOutput::RenderToFramebuffer()
 
 void VideoOutput::BeginFrame()
 {
+    // close metrics for the previous frame
+    LastFrameStatistics = FrameStatistics;
+    memset( &FrameStatistics, 0, sizeof( VideoStatistics ) );
+    RenderedFrames++;
+    
     glUseProgram( ShaderProgramID );
     RenderToFramebuffer();
     glEnable( GL_BLEND );
-    SelectTexture( SelectedTexture );
-    SetBlendingMode( BlendingMode );
-    SetMultiplyColor( MultiplyColor );
+    ApplyBlendingMode();
+    
+    // the frontend may have changed texture bindings,
+    // so the selected texture is bound again when used
+    BoundTextureID = 0;
+    
+    // whether previous contents are needed is only
+    // known when the first drawing is sent to OpenGL
+    FrameDrawingStarted = false;
+    FrameCovered = false;
+    FrameReplacedScreen = false;
+    
+    #if !defined(HAVE_OPENGLES2)
+      if( UseTextureArray )
+        glBindTexture( GL_TEXTURE_2D_ARRAY, TextureArrayID );
+    #endif
     
     // tell the GPU which of its texture processors to use
     glUniform1i( TextureUnitLocation, 0 );  // texture unit 0 is for decal textures
     
+    // all array layers have the same size; otherwise
+    // the scale is set when each texture is bound
+    AppliedTextureScale[ 0 ] = AppliedTextureScale[ 1 ] = 1;
+    
+    if( UseTextureArray )
+    {
+        AppliedTextureScale[ 0 ] = (GLfloat)Constants::GPUTextureSize / TextureArrayWidth;
+        AppliedTextureScale[ 1 ] = (GLfloat)Constants::GPUTextureSize / TextureArrayHeight;
+    }
+    
+    glUniform2f( TextureScaleLocation, AppliedTextureScale[ 0 ], AppliedTextureScale[ 1 ] );
+    
+    // same for palettes, which use texture unit 2
+    if( UsePalettes )
+    {
+        glUniform1i( PaletteUnitLocation, 2 );
+        glUniform1i( UsePaletteLocation, 0 );
+        AppliedPaletteID = 0;
+    }
+    
+    // batches are matched with the last frame in order
+    if( UseRetainedBatches )
+    {
+        NextRetainedBatch = 0;
+        PositionOffsetX = PositionOffsetY = 0;
+        glUniform2f( PositionOffsetLocation, 0, 0 );
+    }
+    
+    #if !defined(HAVE_OPENGLES2)
+      if( UseInstancing )
+      {
+          glActiveTexture( GL_TEXTURE1 );   // texture unit 1 is for region tables
+          glBindTexture( GL_TEXTURE_2D_ARRAY, RegionTableID );
+          glActiveTexture( GL_TEXTURE0 );
+          glUniform1i( RegionTableLocation, 1 );
+      }
+    #endif
+    
     // define storage and format for vertex info
     glBindBuffer( GL_ARRAY_BUFFER, VBOVertexInfo );
+    SetVertexAttributes( 0 );
+    StreamAttributesChanged = false;
     
-    glVertexAttribPointer
-    (
-        VertexInfoLocation, // location (0-based index) within the shader program
-        4,                  // 4 components per vertex (x,y,tex_x,tex_y)
-        GL_FLOAT,           // each component is of type GLfloat
-        GL_FALSE,           // do not normalize values (convert directly to fixed-point)
-        0,                  // no gap between values (adjacent in memory)
-        (void*)0            // starts at offset 0
-    );
+    // vertex indices never change, so they are only
+    // uploaded when rendering is initialized
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, VBOIndices );
+}
+
+
+// -----------------------------------------------------------------------------
+
+// draws anything still queued; after this
+// the framebuffer can be given to libretro
+void VideoOutput::EndFrame()
+{
+    RenderQuadQueue( FlushReasons::FrameEnd );
     
-    glEnableVertexAttribArray( VertexInfoLocation );    
+    if( !CheckErrors )
+      return;
     
-    // allocate memory for vertex indices in the GPU
-    // (vertices are given as triangle strip pairs)
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, VBOIndices );
+    // each error flag is returned once
+    // (limit this in case the context is lost)
+    for( int i = 0; i < 16; i++ )
+    {
+        if( glGetError() == GL_NO_ERROR )
+          break;
+        
+        FrameStatistics.OpenGLErrors++;
+        TotalStatistics.OpenGLErrors++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// called before the first drawing of a frame reaches OpenGL;
+// at that point the framebuffer is overwritten entirely if
+// there is a pending opaque clear or a full screen quad was
+// queued (in that case it is first in the queue)
+void VideoOutput::StartFrameDrawing()
+{
+    FrameDrawingStarted = true;
+    FrameReplacedScreen = (ClearPending || FrameCovered);
     
-    glBufferSubData
-    (
-        GL_ELEMENT_ARRAY_BUFFER,
-        0,
-        QUAD_QUEUE_SIZE * 6 * sizeof( GLushort ),
-        VertexIndices
-    );
+    if( UseFramebufferInvalidation && FrameReplacedScreen )
+    {
+        InvalidateFramebuffer();
+        FrameStatistics.InvalidatedFrames++;
+        TotalStatistics.InvalidatedFrames++;
+    }
+    
+    else
+    {
+        FrameStatistics.PreservedFrames++;
+        TotalStatistics.PreservedFrames++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::InvalidateFramebuffer()
+{
+    // the default framebuffer names its attachments differently
+    bool IsDefaultFramebuffer = (hw_render.get_current_framebuffer() == 0);
+    
+    #if defined(HAVE_OPENGLES2)
+      const GLenum Attachment = (IsDefaultFramebuffer? GL_COLOR_EXT : GL_COLOR_ATTACHMENT0);
+      glDiscardFramebufferEXT( RARCH_GL_FRAMEBUFFER, 1, &Attachment );
+    #else
+      const GLenum Attachment = (IsDefaultFramebuffer? GL_COLOR : GL_COLOR_ATTACHMENT0);
+      glInvalidateFramebuffer( RARCH_GL_FRAMEBUFFER, 1, &Attachment );
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+// true if drawing the last frame again would give the same
+// image: this happens if it did not depend on the previous
+// contents, or if it drew nothing at all and kept them
+bool VideoOutput::IsFrameRepeatable()
+{
+    return FrameReplacedScreen || !FrameDrawingStarted;
 }
 
 
@@ -551,23 +1502,13 @@ void VideoOutput::BeginFrame()
 // =============================================================================
 
 
+// multiply color is written in the vertices of each
+// queued quad, so changing it does not need to render
+// the queue or to update any GPU state
 void VideoOutput::SetMultiplyColor( GPUColor NewMultiplyColor )
 {
-    // we must render any pending quads before
-    // applying any new render configurations
-    RenderQuadQueue();
-    
     MultiplyColor = NewMultiplyColor;
-    
-    // send our multiply color to the GPU
-    glUniform4f
-    (
-        MultiplyColorLocation,      // location (0-based index) within the shader program
-        MultiplyColor.R / 255.0,    // the 4 color components (RGBA) in range [0.0-1.0]
-        MultiplyColor.G / 255.0,
-        MultiplyColor.B / 255.0,
-        MultiplyColor.A / 255.0
-    );
+    UpdateVertexColor();
 }
 
 // -----------------------------------------------------------------------------
@@ -581,40 +1522,220 @@ GPUColor VideoOutput::GetMultiplyColor()
 
 void VideoOutput::SetBlendingMode( IOPortValues NewBlendingMode )
 {
-    // we must render any pending quads before
-    // applying any new render configurations
-    RenderQuadQueue();
+    // ignore invalid values
+    if( NewBlendingMode != IOPortValues::GPUBlendingMode_Alpha
+    &&  NewBlendingMode != IOPortValues::GPUBlendingMode_Add
+    &&  NewBlendingMode != IOPortValues::GPUBlendingMode_Subtract )
+      return;
     
-    switch( NewBlendingMode )
+    // OpenGL state is only changed when the next
+    // quad is queued (see ApplyRenderState)
+    BlendingMode = NewBlendingMode;
+    UpdateVertexColor();
+}
+
+// -----------------------------------------------------------------------------
+
+IOPortValues VideoOutput::GetBlendingMode()
+{
+    return BlendingMode;
+}
+
+// -----------------------------------------------------------------------------
+
+// sends the blend function for the current mode to OpenGL;
+// for premultiplied alpha, source color is already scaled
+void VideoOutput::ApplyBlendingMode()
+{
+    switch( BlendingMode )
     {
         case IOPortValues::GPUBlendingMode_Alpha:
-            glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+            if( UsePremultipliedAlpha )
+              glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+            else
+              glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+            
             glBlendEquation( GL_FUNC_ADD );
             break;
             
         case IOPortValues::GPUBlendingMode_Add:
-            glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+            if( UsePremultipliedAlpha )
+              glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+            else
+              glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+            
             glBlendEquation( GL_FUNC_ADD );
             break;
             
         case IOPortValues::GPUBlendingMode_Subtract:
-            glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+            if( UsePremultipliedAlpha )
+              glBlendFunc( GL_ONE, GL_ONE );
+            else
+              glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+            
             glBlendEquation( GL_FUNC_REVERSE_SUBTRACT );
             break;
         
         default:
-            // ignore invalid values
-            return;
+            break;
     }
     
-    BlendingMode = NewBlendingMode;
+    AppliedBlendingMode = BlendingMode;
 }
 
 // -----------------------------------------------------------------------------
 
-IOPortValues VideoOutput::GetBlendingMode()
+// determines the color to write in queued vertices
+// for a multiply color, given current blending mode
+GPUColor VideoOutput::CalculateVertexColor( GPUColor Color )
 {
-    return BlendingMode;
+    if( !UsePremultipliedAlpha )
+      return Color;
+    
+    GPUColor Result;
+    unsigned Alpha = Color.A;
+    Result.R = (Color.R * Alpha + 127) / 255;
+    Result.G = (Color.G * Alpha + 127) / 255;
+    Result.B = (Color.B * Alpha + 127) / 255;
+    
+    // zero alpha makes the destination be kept
+    // as is, so source color is just added to it
+    if( BlendingMode == IOPortValues::GPUBlendingMode_Add )
+      Result.A = 0;
+    else
+      Result.A = Alpha;
+    
+    return Result;
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::UpdateVertexColor()
+{
+    VertexColor = CalculateVertexColor( MultiplyColor );
+}
+
+
+// =============================================================================
+//      VIDEO OUTPUT: RENDER STATE FUNCTIONS
+// =============================================================================
+
+
+// sends the selected texture and blending mode to OpenGL
+// when they differ from its current state; this way, any
+// number of changes between 2 quads costs at most 1 flush
+void VideoOutput::ApplyRenderState()
+{
+    ApplyPendingBlending();
+    
+    // texture arrays just use the layer in each vertex
+    if( UseTextureArray )
+      return;
+    
+    GLuint SelectedTextureID = BiosTextureID;
+    GLuint SelectedPaletteID = BiosPaletteID;
+    const GLfloat* SelectedTextureScale = BiosTextureScale;
+    
+    if( SelectedTexture >= 0 )
+    {
+        int SourceTexture = CartridgeTextureSources[ SelectedTexture ];
+        
+        // with a memory budget, textures are only
+        // in the GPU after they have been drawn
+        if( TextureMemoryBudget )
+        {
+            if( !CartridgeTextureIDs[ SourceTexture ] && !CartridgeTextureData[ SourceTexture ].Pixels.empty() )
+              MakeTextureResident( SourceTexture );
+            
+            CartridgeTextureLastUse[ SourceTexture ] = RenderedFrames;
+        }
+        
+        SelectedTextureID = CartridgeTextureIDs[ SourceTexture ];
+        SelectedPaletteID = CartridgePaletteIDs[ SourceTexture ];
+        SelectedTextureScale = CartridgeTextureScales[ SourceTexture ];
+    }
+    
+    if( SelectedTextureID != BoundTextureID )
+    {
+        RenderQuadQueue( FlushReasons::TextureChange );
+        BindTexture( SelectedTextureID );
+        SetTextureScale( SelectedTextureScale[ 0 ], SelectedTextureScale[ 1 ] );
+        
+        if( UsePalettes )
+          BindPalette( SelectedPaletteID );
+        
+        FrameStatistics.StateChanges++;
+        TotalStatistics.StateChanges++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::ApplyPendingBlending()
+{
+    // with premultiplied alpha, alpha and additive blending
+    // use the same OpenGL state, so the queue can continue
+    bool BlendingChanged = (BlendingMode != AppliedBlendingMode);
+    
+    if( UsePremultipliedAlpha
+    &&  BlendingMode != IOPortValues::GPUBlendingMode_Subtract
+    &&  AppliedBlendingMode != IOPortValues::GPUBlendingMode_Subtract )
+      BlendingChanged = false;
+    
+    if( BlendingChanged )
+    {
+        RenderQuadQueue( FlushReasons::BlendingChange );
+        ApplyBlendingMode();
+        FrameStatistics.StateChanges++;
+        TotalStatistics.StateChanges++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::BindTexture( GLuint OpenGLTextureID )
+{
+    glBindTexture( GL_TEXTURE_2D, OpenGLTextureID );
+    BoundTextureID = OpenGLTextureID;
+    FrameStatistics.TextureBinds++;
+    TotalStatistics.TextureBinds++;
+}
+
+// -----------------------------------------------------------------------------
+
+// only call this within a frame, while our shader is in use;
+// a palette ID of 0 means that the texture has no palette
+void VideoOutput::BindPalette( GLuint PaletteID )
+{
+    if( PaletteID == AppliedPaletteID )
+      return;
+    
+    if( PaletteID )
+    {
+        glActiveTexture( GL_TEXTURE2 );
+        glBindTexture( GL_TEXTURE_2D, PaletteID );
+        glActiveTexture( GL_TEXTURE0 );
+        FrameStatistics.TextureBinds++;
+        TotalStatistics.TextureBinds++;
+    }
+    
+    if( (PaletteID != 0) != (AppliedPaletteID != 0) )
+      glUniform1i( UsePaletteLocation, (PaletteID != 0) );
+    
+    AppliedPaletteID = PaletteID;
+}
+
+// -----------------------------------------------------------------------------
+
+// only call this within a frame, while our shader is in use
+void VideoOutput::SetTextureScale( GLfloat ScaleX, GLfloat ScaleY )
+{
+    if( ScaleX == AppliedTextureScale[ 0 ] && ScaleY == AppliedTextureScale[ 1 ] )
+      return;
+    
+    glUniform2f( TextureScaleLocation, ScaleX, ScaleY );
+    AppliedTextureScale[ 0 ] = ScaleX;
+    AppliedTextureScale[ 1 ] = ScaleY;
 }
 
 
@@ -625,48 +1746,171 @@ IOPortValues VideoOutput::GetBlendingMode()
 
 void VideoOutput::AddQuadToQueue( const GPUQuad& Quad )
 {
-    // copy information from the received GPU quad
-    const int SizePerQuad = 16 * sizeof( float );
-    memcpy( &QuadVerticesInfo[ QueuedQuads * 16 ], &Quad.Vertices, SizePerQuad );
+    if( IsOccludingQuad( Quad ) )
+      DiscardOccludedDrawing();
+    
+    ApplyRenderState();
+    QueueQuad( Quad, VertexColor, SelectedLayer );
+}
+
+// -----------------------------------------------------------------------------
+
+// adds a quad to the queue without checking render state
+void VideoOutput::QueueQuad( const GPUQuad& Quad, GPUColor Color, GLfloat Layer )
+{
+    GLfloat* QuadInfo = &QuadVerticesInfo[ QueuedQuads * 4 * ValuesPerVertex ];
+    
+    for( int v = 0; v < 4; v++ )
+    {
+        GLfloat* VertexInfo = &QuadInfo[ v * ValuesPerVertex ];
+        
+        // copy information from the received GPU quad
+        memcpy( VertexInfo, &Quad.Vertices[ v ], 4 * sizeof( float ) );
+        
+        // add the multiply color, with its bytes in
+        // the same RGBA order expected by OpenGL
+        memcpy( &VertexInfo[ 4 ], &Color, sizeof( GPUColor ) );
+        
+        // with texture arrays, also add the layer
+        if( UseTextureArray )
+          VertexInfo[ 5 ] = Layer;
+    }
     
     // update the queue
     QueuedQuads++;
     
     // force queue draw if it becomes full
     if( QueuedQuads >= QUAD_QUEUE_SIZE )
-      RenderQuadQueue();
+      RenderQuadQueue( FlushReasons::QueueFull );
+}
+
+// -----------------------------------------------------------------------------
+
+// writes data for a batch into the vertex buffer (which
+// must be bound) and returns its offset within the buffer
+GLintptr VideoOutput::WriteToVertexStream( const void* Data, GLsizeiptr Size )
+{
+    FrameStatistics.VertexBytes += Size;
+    TotalStatistics.VertexBytes += Size;
+    
+    #if defined(HAVE_OPENGLES2)
+      
+      // send updated vertex info to the GPU; note that
+      // we would normally not update the whole buffer
+      // every time, but some mobile GPUs have a bug
+      // which causes very low performance on partial
+      // GPU buffer updates: respecifying the buffer
+      // orphans the old one instead of waiting for it
+      glBufferData
+      (
+          GL_ARRAY_BUFFER,
+          Size,
+          Data,
+          GL_STREAM_DRAW
+      );
+      
+      FrameStatistics.BufferOrphans++;
+      TotalStatistics.BufferOrphans++;
+      return 0;
+    
+    #else
+      
+      // when the stream is full, orphan it: the driver gives
+      // us new storage while previous draws still use the old
+      const GLsizeiptr StreamSize = QUAD_STREAM_SIZE * 4 * ValuesPerVertex * sizeof( GLfloat );
+      
+      if( StreamOffset + Size > StreamSize )
+      {
+          glBufferData( GL_ARRAY_BUFFER, StreamSize, nullptr, GL_STREAM_DRAW );
+          StreamOffset = 0;
+          FrameStatistics.BufferOrphans++;
+          TotalStatistics.BufferOrphans++;
+      }
+      
+      // this region has not been used since the last orphaning,
+      // so it is safe to write it without any synchronization
+      void* MappedVertices = glMapBufferRange
+      (
+          GL_ARRAY_BUFFER,
+          StreamOffset,
+          Size,
+          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+      );
+      
+      if( MappedVertices )
+      {
+          memcpy( MappedVertices, Data, Size );
+          glUnmapBuffer( GL_ARRAY_BUFFER );
+      }
+      
+      else glBufferSubData( GL_ARRAY_BUFFER, StreamOffset, Size, Data );
+      
+      GLintptr BatchOffset = StreamOffset;
+      StreamOffset += Size;
+      return BatchOffset;
+    
+    #endif
 }
 
 // -----------------------------------------------------------------------------
 
-void VideoOutput::RenderQuadQueue()
+void VideoOutput::RenderQuadQueue( FlushReasons Reason )
 {
+    if( !FrameDrawingStarted && (ClearPending || QueuedQuads > 0) )
+      StartFrameDrawing();
+    
+    if( ClearPending )
+      ApplyPendingClear();
+    
     if( QueuedQuads == 0 ) return;
     
-    // send attributes (i.e. shader input variables)
-    glBindBuffer( GL_ARRAY_BUFFER, VBOVertexInfo );
+    FrameStatistics.Flushes[ (int)Reason ]++;
+    TotalStatistics.Flushes[ (int)Reason ]++;
     
-    // send updated vertex info to the GPU; note that
-    // we would normally not update the whole buffer
-    // every time, but some mobile GPUs have a bug
-    // which causes very low performance on partial
-    // GPU buffer updates
-    glBufferSubData
-    (
-        GL_ARRAY_BUFFER,
-        0,
-        sizeof( QuadVerticesInfo ),
-        QuadVerticesInfo
-    );
+    if( UseInstancing )
+    {
+        RenderInstanceQueue();
+        return;
+    }
     
-    // draw each quad as 2 triangles
-    glDrawElements
-    (
-        GL_TRIANGLES,         // independent triangles
-        QueuedQuads * 6,      // number of indices
-        GL_UNSIGNED_SHORT,    // format of indices
-        (void*)0              // starts at offset 0
-    );
+    // large batches may reuse vertices from the last frame
+    if( !UseRetainedBatches || !RenderRetainedBatch() )
+    {
+        // send attributes (i.e. shader input variables)
+        glBindBuffer( GL_ARRAY_BUFFER, VBOVertexInfo );
+        GLsizeiptr BatchSize = QueuedQuads * 4 * ValuesPerVertex * sizeof( GLfloat );
+        GLintptr BatchOffset = WriteToVertexStream( QuadVerticesInfo, BatchSize );
+        
+        // indices are always relative to the start of the batch
+        #if !defined(HAVE_OPENGLES2)
+          SetVertexAttributes( BatchOffset );
+        #else
+          if( StreamAttributesChanged )
+            SetVertexAttributes( 0 );
+          
+          (void)BatchOffset;
+        #endif
+        
+        StreamAttributesChanged = false;
+        
+        if( UseRetainedBatches )
+          SetPositionOffset( 0, 0 );
+        
+        // draw each quad as 2 triangles
+        glDrawElements
+        (
+            GL_TRIANGLES,         // independent triangles
+            QueuedQuads * 6,      // number of indices
+            GL_UNSIGNED_SHORT,    // format of indices
+            (void*)0              // starts at offset 0
+        );
+    }
+    
+    // update metrics
+    FrameStatistics.Quads += QueuedQuads;
+    FrameStatistics.DrawCalls++;
+    TotalStatistics.Quads += QueuedQuads;
+    TotalStatistics.DrawCalls++;
     
     // reset the queue
     QueuedQuads = 0;
@@ -676,12 +1920,53 @@ void VideoOutput::RenderQuadQueue()
 
 void VideoOutput::ClearScreen( GPUColor ClearColor )
 {
-    // temporarily replace multiply color with clear color
-    GPUColor PreviousMultiplyColor = MultiplyColor;
-    SetMultiplyColor( ClearColor );
+    // opaque clears with alpha blending replace every
+    // pixel with the clear color, so OpenGL can do them
+    if( ClearColor.A == 255 && BlendingMode == IOPortValues::GPUBlendingMode_Alpha )
+    {
+        // nothing drawn before the clear can be seen
+        DiscardOccludedDrawing();
+        ClearPending = true;
+        PendingClearColor = ClearColor;
+        return;
+    }
+    
+    // otherwise draw a full screen quad; the clear color
+    // is only written in its vertices, so multiply color
+    // and selected texture do not need to be changed
+    GPUColor ClearVertexColor = CalculateVertexColor( ClearColor );
+    ApplyPendingBlending();
+    
+    // instanced rendering has its own full screen quads
+    if( UseInstancing )
+    {
+        RegionInstance* Instance = &QueuedInstances[ QueuedQuads ];
+        memset( Instance, 0, sizeof( RegionInstance ) );
+        Instance->RegionID = -1;
+        Instance->TextureLayer = -1;
+        Instance->Color = ClearVertexColor;
+        
+        QueuedQuads++;
+        
+        if( QueuedQuads >= QUAD_QUEUE_SIZE )
+          RenderQuadQueue( FlushReasons::QueueFull );
+        
+        return;
+    }
     
-    // bind white texture
-    glBindTexture( GL_TEXTURE_2D, WhiteTextureID );
+    // use white texture; for texture arrays a negative
+    // layer means solid color so the batch can continue
+    if( !UseTextureArray && BoundTextureID != WhiteTextureID )
+    {
+        RenderQuadQueue( FlushReasons::ScreenClear );
+        BindTexture( WhiteTextureID );
+        
+        if( UsePalettes )
+          BindPalette( 0 );
+        
+        FrameStatistics.StateChanges++;
+        TotalStatistics.StateChanges++;
+    }
     
     // set a full-screen quad with the same texture pixel
     const GPUQuad ScreenQuad =
@@ -695,34 +1980,642 @@ void VideoOutput::ClearScreen( GPUColor ClearColor )
         }
     };
     
-    // draw this quad separately, since we are
-    // using different render configurations
-    AddQuadToQueue( ScreenQuad );
-    RenderQuadQueue();
-    
-    // restore previous multiply color and texture
-    SetMultiplyColor( PreviousMultiplyColor );
-    SelectTexture( SelectedTexture );
+    QueueQuad( ScreenQuad, ClearVertexColor, -1 );
 }
 
 
 // =============================================================================
-//      VIDEO OUTPUT: TEXTURE HANDLING
+//      VIDEO OUTPUT: OCCLUSION CULLING
 // =============================================================================
 
 
-void VideoOutput::LoadTexture( int GPUTextureID, void* Pixels )
+// marks the tiles that are fully inside the texture's real
+// size and where all texels are opaque; the texels outside
+// are whatever the texture storage has, so never opaque
+void VideoOutput::UpdateTextureOpacity( int GPUTextureID, const void* Pixels, int Width, int Height )
 {
-    LOG( "Loading texture with ID = " + to_string(GPUTextureID) );
+    TextureOpacityMap& Opacity = (GPUTextureID >= 0? CartridgeTextureOpacity[ GPUTextureID ] : BiosTextureOpacity);
+    memset( &Opacity, 0, sizeof( TextureOpacityMap ) );
+    
+    const GPUColor* Texels = (const GPUColor*)Pixels;
+    int TileColumns = min( Width, Constants::GPUTextureSize ) / OPACITY_TILE_SIZE;
+    int TileRows = min( Height, Constants::GPUTextureSize ) / OPACITY_TILE_SIZE;
+    
+    for( int TileY = 0; TileY < TileRows; TileY++ )
+      for( int TileX = 0; TileX < TileColumns; TileX++ )
+      {
+          bool IsOpaque = true;
+          
+          for( int y = 0; y < OPACITY_TILE_SIZE && IsOpaque; y++ )
+          {
+              const GPUColor* Row = &Texels[ (TileY * OPACITY_TILE_SIZE + y) * Width + TileX * OPACITY_TILE_SIZE ];
+              
+              for( int x = 0; x < OPACITY_TILE_SIZE; x++ )
+                if( Row[ x ].A != 255 )
+                {
+                    IsOpaque = false;
+                    break;
+                }
+          }
+          
+          if( IsOpaque )
+            Opacity.TileRows[ TileY ][ TileX / 64 ] |= 1ULL << (TileX % 64);
+      }
+}
+
+// -----------------------------------------------------------------------------
+
+// texel limits are inclusive
+bool VideoOutput::IsTextureAreaOpaque( int GPUTextureID, int MinX, int MinY, int MaxX, int MaxY )
+{
+    if( MinX < 0 || MinY < 0 || MaxX >= Constants::GPUTextureSize || MaxY >= Constants::GPUTextureSize )
+      return false;
     
-    GLuint* OpenGLTextureID = &BiosTextureID;
+    const TextureOpacityMap& Opacity =
+      (GPUTextureID >= 0? CartridgeTextureOpacity[ CartridgeTextureSources[ GPUTextureID ] ] : BiosTextureOpacity);
     
-    if( GPUTextureID >= 0 )
-      OpenGLTextureID = &CartridgeTextureIDs[ GPUTextureID ];
+    for( int TileY = MinY / OPACITY_TILE_SIZE; TileY <= MaxY / OPACITY_TILE_SIZE; TileY++ )
+      for( int TileX = MinX / OPACITY_TILE_SIZE; TileX <= MaxX / OPACITY_TILE_SIZE; TileX++ )
+        if( !(Opacity.TileRows[ TileY ][ TileX / 64 ] & (1ULL << (TileX % 64))) )
+          return false;
     
-    // create a new OpenGL texture and select it
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+// full screen quads save work when they replace queued drawing,
+// or when they start the frame (previous contents are not needed)
+bool VideoOutput::IsOcclusionUseful()
+{
+    return QueuedQuads > 0 || ClearPending || !FrameDrawingStarted;
+}
+
+// -----------------------------------------------------------------------------
+
+// true when the quad will replace every pixel on screen,
+// so that anything not yet drawn before it can be skipped
+bool VideoOutput::IsOccludingQuad( const GPUQuad& Quad )
+{
+    if( !IsOcclusionUseful() )
+      return false;
+    
+    // only opaque pixels with alpha blending replace
+    // the previous ones (other modes combine them)
+    if( BlendingMode != IOPortValues::GPUBlendingMode_Alpha || VertexColor.A != 255 )
+      return false;
+    
+    if( !QuadCoversScreen( Quad ) )
+      return false;
+    
+    // all texels that can be sampled must be opaque
+    float TextureMinX = Quad.Vertices[ 0 ].texture_x, TextureMaxX = TextureMinX;
+    float TextureMinY = Quad.Vertices[ 0 ].texture_y, TextureMaxY = TextureMinY;
+    
+    for( int v = 1; v < 4; v++ )
+    {
+        TextureMinX = min( TextureMinX, Quad.Vertices[ v ].texture_x );
+        TextureMaxX = max( TextureMaxX, Quad.Vertices[ v ].texture_x );
+        TextureMinY = min( TextureMinY, Quad.Vertices[ v ].texture_y );
+        TextureMaxY = max( TextureMaxY, Quad.Vertices[ v ].texture_y );
+    }
+    
+    // (negated comparisons so that NaN is rejected)
+    if( !(TextureMinX >= 0 && TextureMinY >= 0 && TextureMaxX < 1 && TextureMaxY < 1) )
+      return false;
+    
+    return IsTextureAreaOpaque
+    (
+        SelectedTexture,
+        (int)(TextureMinX * Constants::GPUTextureSize),
+        (int)(TextureMinY * Constants::GPUTextureSize),
+        (int)(TextureMaxX * Constants::GPUTextureSize),
+        (int)(TextureMaxY * Constants::GPUTextureSize)
+    );
+}
+
+// -----------------------------------------------------------------------------
+
+// only drawing still in the queue can be discarded:
+// batches already sent to OpenGL are drawn anyway
+void VideoOutput::DiscardOccludedDrawing()
+{
+    FrameStatistics.OccludedQuads += QueuedQuads;
+    TotalStatistics.OccludedQuads += QueuedQuads;
+    QueuedQuads = 0;
+    
+    if( !FrameDrawingStarted )
+      FrameCovered = true;
+    
+    if( ClearPending )
+    {
+        ClearPending = false;
+        FrameStatistics.SkippedClears++;
+        TotalStatistics.SkippedClears++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::ApplyPendingClear()
+{
+    ClearPending = false;
+    glClearColor( PendingClearColor.R / 255.0, PendingClearColor.G / 255.0, PendingClearColor.B / 255.0, 1.0 );
+    glClear( GL_COLOR_BUFFER_BIT );
+}
+
+
+// =============================================================================
+//      VIDEO OUTPUT: INSTANCED RENDER FUNCTIONS
+// =============================================================================
+
+
+void VideoOutput::AddRegionToQueue( const GPURegionDrawing& Drawing )
+{
+    // most regions are small, so only build their
+    // quad when there is some drawing to discard
+    if( IsOcclusionUseful() && IsOccludingQuad( GetRegionDrawingQuad( Drawing ) ) )
+      DiscardOccludedDrawing();
+    
+    ApplyRenderState();
+    int Layer = SelectedTexture + 1;
+    GLshort* TableEntry = &RegionTables[ 8 * (Layer * Constants::GPURegionsPerTexture + Drawing.RegionID) ];
+    
+    GLshort Region[ 8 ] =
+    {
+        (GLshort)Drawing.MinX, (GLshort)Drawing.MinY,
+        (GLshort)Drawing.MaxX, (GLshort)Drawing.MaxY,
+        (GLshort)Drawing.HotspotX, (GLshort)Drawing.HotspotY,
+        0, 0
+    };
+    
+    // region tables are only sent to the GPU when some
+    // region is drawn after its definition has changed
+    if( memcmp( TableEntry, Region, sizeof( Region ) ) )
+    {
+        // queued instances still need the previous values
+        RenderQuadQueue( FlushReasons::RegionTableChange );
+        memcpy( TableEntry, Region, sizeof( Region ) );
+        
+        int Row = Drawing.RegionID / REGIONS_PER_TABLE_ROW;
+        FirstChangedRow[ Layer ] = min( FirstChangedRow[ Layer ], Row );
+        LastChangedRow[ Layer ] = max( LastChangedRow[ Layer ], Row );
+        RegionTablesChanged = true;
+    }
+    
+    // rotation is given as precalculated cos and sin
+    // so that it is calculated just like the console
+    RegionInstance* Instance = &QueuedInstances[ QueuedQuads ];
+    Instance->DrawingPointX = Drawing.DrawingPointX;
+    Instance->DrawingPointY = Drawing.DrawingPointY;
+    Instance->DrawingScaleX = Drawing.DrawingScaleX;
+    Instance->DrawingScaleY = Drawing.DrawingScaleY;
+    Instance->AngleCos = cos( Drawing.DrawingAngle );
+    Instance->AngleSin = sin( Drawing.DrawingAngle );
+    Instance->RegionID = Drawing.RegionID;
+    Instance->TextureLayer = Layer;
+    Instance->Color = VertexColor;
+    
+    // update the queue
+    QueuedQuads++;
+    
+    // force queue draw if it becomes full
+    if( QueuedQuads >= QUAD_QUEUE_SIZE )
+      RenderQuadQueue( FlushReasons::QueueFull );
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::RenderInstanceQueue()
+{
+    #if !defined(HAVE_OPENGLES2)
+      
+      if( QueuedQuads == 0 ) return;
+      UpdateRegionTables();
+      
+      // send instances to the vertex stream
+      glBindBuffer( GL_ARRAY_BUFFER, VBOVertexInfo );
+      GLsizeiptr BatchSize = QueuedQuads * sizeof( RegionInstance );
+      SetVertexAttributes( WriteToVertexStream( QueuedInstances, BatchSize ) );
+      
+      // each instance is a 4 vertex strip
+      glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, QueuedQuads );
+      
+      // update metrics
+      FrameStatistics.Quads += QueuedQuads;
+      FrameStatistics.DrawCalls++;
+      TotalStatistics.Quads += QueuedQuads;
+      TotalStatistics.DrawCalls++;
+      
+      // reset the queue
+      QueuedQuads = 0;
+    
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+// sends the changed rows of each region table to the GPU
+void VideoOutput::UpdateRegionTables()
+{
+    #if !defined(HAVE_OPENGLES2)
+      
+      if( !RegionTablesChanged )
+        return;
+      
+      glActiveTexture( GL_TEXTURE1 );
+      glBindTexture( GL_TEXTURE_2D_ARRAY, RegionTableID );
+      
+      for( int Layer = 0; Layer < TextureArrayLayers; Layer++ )
+      {
+          if( FirstChangedRow[ Layer ] > LastChangedRow[ Layer ] )
+            continue;
+          
+          int FirstRegion = Layer * Constants::GPURegionsPerTexture + FirstChangedRow[ Layer ] * REGIONS_PER_TABLE_ROW;
+          
+          glTexSubImage3D
+          (
+              GL_TEXTURE_2D_ARRAY,
+              0,
+              0, FirstChangedRow[ Layer ], Layer,       // x, y, layer
+              2 * REGIONS_PER_TABLE_ROW,                // width in texels
+              LastChangedRow[ Layer ] - FirstChangedRow[ Layer ] + 1,
+              1,                                        // layers
+              GL_RGBA_INTEGER,
+              GL_SHORT,
+              &RegionTables[ 8 * FirstRegion ]
+          );
+          
+          // each region is 8 shorts
+          uint64_t UploadedBytes = (LastChangedRow[ Layer ] - FirstChangedRow[ Layer ] + 1) * REGIONS_PER_TABLE_ROW * 8 * sizeof( GLshort );
+          FrameStatistics.TextureBytes += UploadedBytes;
+          TotalStatistics.TextureBytes += UploadedBytes;
+          
+          FirstChangedRow[ Layer ] = Constants::GPURegionsPerTexture;
+          LastChangedRow[ Layer ] = -1;
+      }
+      
+      glActiveTexture( GL_TEXTURE0 );
+      RegionTablesChanged = false;
+    
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+
+// region tables have a layer for every texture, as in
+// the texture array; their contents are sent again
+void VideoOutput::ResizeRegionTables( int NewLayers )
+{
+    #if !defined(HAVE_OPENGLES2)
+      
+      const int TableRows = Constants::GPURegionsPerTexture / REGIONS_PER_TABLE_ROW;
+      RegionTables.resize( 8 * NewLayers * Constants::GPURegionsPerTexture, 0 );
+      FirstChangedRow.assign( NewLayers, 0 );
+      LastChangedRow.assign( NewLayers, TableRows - 1 );
+      RegionTablesChanged = true;
+      
+      ReleaseTexture( RegionTableID );
+      ClearOpenGLErrors();
+      
+      glActiveTexture( GL_TEXTURE1 );
+      glGenTextures( 1, &RegionTableID );
+      glBindTexture( GL_TEXTURE_2D_ARRAY, RegionTableID );
+      
+      glTexImage3D
+      (
+          GL_TEXTURE_2D_ARRAY,
+          0,
+          GL_RGBA16I,                   // 4 signed 16-bit integers per texel
+          2 * REGIONS_PER_TABLE_ROW,    // width in texels
+          TableRows,                    // height in texels
+          NewLayers,                    // number of layers
+          0,
+          GL_RGBA_INTEGER,
+          GL_SHORT,
+          nullptr
+      );
+      
+      if( glGetError() != GL_NO_ERROR )
+        THROW( "Could not create region tables with " + to_string( NewLayers ) + " layers" );
+      
+      // integer textures are only complete with nearest filters
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glActiveTexture( GL_TEXTURE0 );
+    
+    #endif
+}
+
+
+// =============================================================================
+//      VIDEO OUTPUT: RETAINED BATCH FUNCTIONS
+// =============================================================================
+
+
+// draws the queue from a retained buffer, either reusing
+// it or updating it for the next frame; returns false if
+// the queue must be drawn from the vertex stream instead
+bool VideoOutput::RenderRetainedBatch()
+{
+    if( QueuedQuads < RETAINED_BATCH_MINIMUM_QUADS || NextRetainedBatch >= RETAINED_BATCH_SLOTS )
+      return false;
+    
+    RetainedBatch& Batch = RetainedBatches[ NextRetainedBatch++ ];
+    glBindBuffer( GL_ARRAY_BUFFER, Batch.VBO );
+    GLfloat OffsetX = 0, OffsetY = 0;
+    
+    if( MatchesRetainedBatch( Batch, OffsetX, OffsetY ) )
+    {
+        FrameStatistics.RetainedHits++;
+        TotalStatistics.RetainedHits++;
+    }
+    
+    // any difference other than a translation
+    // replaces the retained vertices completely
+    else
+    {
+        int BatchValues = QueuedQuads * 4 * ValuesPerVertex;
+        glBufferData( GL_ARRAY_BUFFER, BatchValues * sizeof( GLfloat ), QuadVerticesInfo, GL_DYNAMIC_DRAW );
+        Batch.Vertices.assign( QuadVerticesInfo, QuadVerticesInfo + BatchValues );
+        Batch.Quads = QueuedQuads;
+        
+        // a failed match may have set an offset
+        OffsetX = OffsetY = 0;
+        
+        FrameStatistics.RetainedMisses++;
+        TotalStatistics.RetainedMisses++;
+        FrameStatistics.VertexBytes += BatchValues * sizeof( GLfloat );
+        TotalStatistics.VertexBytes += BatchValues * sizeof( GLfloat );
+    }
+    
+    SetVertexAttributes( 0 );
+    SetPositionOffset( OffsetX, OffsetY );
+    StreamAttributesChanged = true;
+    
+    glDrawElements( GL_TRIANGLES, QueuedQuads * 6, GL_UNSIGNED_SHORT, (void*)0 );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+// the queue matches only if every vertex position is moved
+// by the same offset, and everything else is identical;
+// positions are compared exactly as the shader adds them
+bool VideoOutput::MatchesRetainedBatch( const RetainedBatch& Batch, GLfloat& OffsetX, GLfloat& OffsetY )
+{
+    if( Batch.Quads != QueuedQuads )
+      return false;
+    
+    const GLfloat* RetainedVertex = Batch.Vertices.data();
+    const GLfloat* QueuedVertex = QuadVerticesInfo;
+    OffsetX = QueuedVertex[ 0 ] - RetainedVertex[ 0 ];
+    OffsetY = QueuedVertex[ 1 ] - RetainedVertex[ 1 ];
+    
+    for( int v = 0; v < 4 * QueuedQuads; v++ )
+    {
+        if( RetainedVertex[ 0 ] + OffsetX != QueuedVertex[ 0 ]
+        ||  RetainedVertex[ 1 ] + OffsetY != QueuedVertex[ 1 ] )
+          return false;
+        
+        // texture coordinates, color and layer
+        if( memcmp( &RetainedVertex[ 2 ], &QueuedVertex[ 2 ], (ValuesPerVertex - 2) * sizeof( GLfloat ) ) )
+          return false;
+        
+        RetainedVertex += ValuesPerVertex;
+        QueuedVertex += ValuesPerVertex;
+    }
+    
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void VideoOutput::SetPositionOffset( GLfloat OffsetX, GLfloat OffsetY )
+{
+    if( OffsetX == PositionOffsetX && OffsetY == PositionOffsetY )
+      return;
+    
+    glUniform2f( PositionOffsetLocation, OffsetX, OffsetY );
+    PositionOffsetX = OffsetX;
+    PositionOffsetY = OffsetY;
+}
+
+
+// =============================================================================
+//      VIDEO OUTPUT: TEXTURE HANDLING
+// =============================================================================
+
+
+void VideoOutput::LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height )
+{
+    LOG( "Loading texture with ID = " + to_string(GPUTextureID) );
+    UpdateTextureOpacity( GPUTextureID, Pixels, Width, Height );
+    
+    LoadedTexture& Copy = (GPUTextureID >= 0? CartridgeTextureCopies[ GPUTextureID ] : BiosTextureCopy);
+    Copy.Width = Width;
+    Copy.Height = Height;
+    Copy.Pixels.assign( (const uint8_t*)Pixels, (const uint8_t*)Pixels + 4 * Width * Height );
+    
+    // with no context, the texture is created
+    // later on when rendering is initialized
+    if( IsInitialized )
+      CreateTexture( GPUTextureID );
+}
+
+// -----------------------------------------------------------------------------
+
+// creates the OpenGL texture (or texture array
+// layer) for a loaded texture, from its copy
+void VideoOutput::CreateTexture( int GPUTextureID )
+{
+    const LoadedTexture& Copy = (GPUTextureID >= 0? CartridgeTextureCopies[ GPUTextureID ] : BiosTextureCopy);
+    const void* Pixels = Copy.Pixels.data();
+    int Width = Copy.Width;
+    int Height = Copy.Height;
+    
+    // textures are stored at their real size rounded up;
+    // in texture array mode, all layers share the largest
+    int StorageWidth = GetTextureStorageSize( Width );
+    int StorageHeight = GetTextureStorageSize( Height );
+    
+    #if !defined(HAVE_OPENGLES2)
+      if( UseTextureArray )
+      {
+          int Layer = GPUTextureID + 1;
+          int NewWidth = max( StorageWidth, TextureArrayWidth );
+          int NewHeight = max( StorageHeight, TextureArrayHeight );
+          
+          // (layers after this one are loaded later)
+          if( Layer >= TextureArrayLayers || NewWidth != TextureArrayWidth || NewHeight != TextureArrayHeight )
+            ResizeTextureArray( max( Layer + 1, TextureArrayLayers ), Layer, NewWidth, NewHeight );
+          
+          StorageWidth = TextureArrayWidth;
+          StorageHeight = TextureArrayHeight;
+      }
+    #endif
+    
+    StoredTexture Texture;
+    PrepareTexture( Pixels, Width, Height, StorageWidth, StorageHeight, Texture );
+    
+    // update metrics
+    int StoredPixelCount = StorageWidth * StorageHeight;
+    TextureMemory.Textures++;
+    
+    if( Texture.IsPalettized )
+    {
+        TextureMemory.PalettizedTextures++;
+        TextureMemory.StoredBytes += StoredPixelCount + 256 * 4;
+        TextureMemory.SavedBytes += 3 * StoredPixelCount - 256 * 4;
+    }
+    
+    else TextureMemory.StoredBytes += 4 * StoredPixelCount;
+    
+    // in texture array mode, just fill the layer
+    #if !defined(HAVE_OPENGLES2)
+      if( UseTextureArray )
+      {
+          glBindTexture( GL_TEXTURE_2D_ARRAY, TextureArrayID );
+          glGetError();
+          
+          glTexSubImage3D
+          (
+              GL_TEXTURE_2D_ARRAY,
+              0,                            // level of detail (0 = normal size)
+              0, 0, GPUTextureID + 1,       // x, y, layer
+              StorageWidth,                 // width in pixels
+              StorageHeight,                // height in pixels
+              1,                            // layers
+              GL_RGBA,                      // color components in the source
+              GL_UNSIGNED_BYTE,             // each color component is a byte
+              Texture.Pixels.data()         // buffer storing the texture data
+          );
+          
+          if( glGetError() != GL_NO_ERROR )
+            THROW( "Could not load pixel data into the texture array" );
+          
+          FrameStatistics.TextureBytes += GetStoredTextureBytes( Texture );
+          TotalStatistics.TextureBytes += GetStoredTextureBytes( Texture );
+          return;
+      }
+    #endif
+    
+    // with a memory budget, cartridge textures
+    // are uploaded when they are first drawn
+    if( TextureMemoryBudget && GPUTextureID >= 0 )
+    {
+        CartridgeTextureData[ GPUTextureID ] = move( Texture );
+        CartridgeTextureLastUse[ GPUTextureID ] = 0;
+        return;
+    }
+    
+    if( !UploadTexture( GPUTextureID, Texture ) )
+      THROW( "Could not create an OpenGL texture from pixel data" );
+}
+
+// -----------------------------------------------------------------------------
+
+// creates all textures that were loaded when there was no
+// context (e.g. at game load, or before a context reset)
+void VideoOutput::RecreateTextures()
+{
+    int LoadedTextures = (BiosTextureCopy.Pixels.empty()? 0 : 1);
+    
+    for( const LoadedTexture& Copy: CartridgeTextureCopies )
+      if( !Copy.Pixels.empty() )
+        LoadedTextures++;
+    
+    if( !LoadedTextures )
+      return;
+    
+    LOG( "Creating " + to_string( LoadedTextures ) + " loaded textures" );
+    
+    // size the texture array only once, for the largest texture
+    #if !defined(HAVE_OPENGLES2)
+      if( UseTextureArray )
+      {
+          int NewWidth = TextureArrayWidth;
+          int NewHeight = TextureArrayHeight;
+          int NewLayers = max( TextureArrayLayers, ReservedCartridgeTextures + 1 );
+          
+          if( !BiosTextureCopy.Pixels.empty() )
+          {
+              NewWidth = max( NewWidth, GetTextureStorageSize( BiosTextureCopy.Width ) );
+              NewHeight = max( NewHeight, GetTextureStorageSize( BiosTextureCopy.Height ) );
+          }
+          
+          for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+            if( !CartridgeTextureCopies[ i ].Pixels.empty() )
+            {
+                NewWidth = max( NewWidth, GetTextureStorageSize( CartridgeTextureCopies[ i ].Width ) );
+                NewHeight = max( NewHeight, GetTextureStorageSize( CartridgeTextureCopies[ i ].Height ) );
+                NewLayers = max( NewLayers, i + 2 );
+            }
+          
+          ResizeTextureArray( NewLayers, 0, NewWidth, NewHeight );
+      }
+    #endif
+    
+    if( !BiosTextureCopy.Pixels.empty() )
+      CreateTexture( -1 );
+    
+    for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+      if( !CartridgeTextureCopies[ i ].Pixels.empty() )
+        CreateTexture( i );
+}
+
+// -----------------------------------------------------------------------------
+
+// converts RGBA pixels to the format they are stored
+// with in the GPU, padded to the given storage size
+void VideoOutput::PrepareTexture( const void* Pixels, int Width, int Height, int StorageWidth, int StorageHeight, StoredTexture& Texture )
+{
+    Texture.StorageWidth = StorageWidth;
+    Texture.StorageHeight = StorageHeight;
+    Texture.IsPalettized = false;
+    
+    // in palette mode, try to store the texture as indices
+    // (very small textures would need more memory this way)
+    if( UsePalettes && 3 * StorageWidth * StorageHeight > 256 * 4 )
+    {
+        Texture.Pixels.resize( StorageWidth * StorageHeight );
+        Texture.IsPalettized = PalettizeTexturePixels( (const uint8_t*)Pixels, Width, Height, Texture.Pixels.data(), StorageWidth, StorageHeight, Texture.Palette );
+        
+        if( Texture.IsPalettized )
+        {
+            if( UsePremultipliedAlpha )
+              PremultiplyAlpha( (const uint8_t*)Texture.Palette, (uint8_t*)Texture.Palette, 256 );
+            
+            return;
+        }
+    }
+    
+    // otherwise pad to the stored size, and in
+    // premultiplied alpha mode also convert colors
+    Texture.Pixels.resize( 4 * StorageWidth * StorageHeight );
+    ExpandTexturePixels( (const uint8_t*)Pixels, Width, Height, Texture.Pixels.data(), StorageWidth, StorageHeight, UsePremultipliedAlpha );
+}
+
+// -----------------------------------------------------------------------------
+
+// creates the OpenGL texture (and palette, if needed)
+// for a prepared texture; returns false on GL errors
+bool VideoOutput::UploadTexture( int GPUTextureID, const StoredTexture& Texture )
+{
+    GLuint* OpenGLTextureID = &BiosTextureID;
+    GLuint* PaletteID = &BiosPaletteID;
+    GLfloat* TextureScale = BiosTextureScale;
+    
+    if( GPUTextureID >= 0 )
+    {
+        OpenGLTextureID = &CartridgeTextureIDs[ GPUTextureID ];
+        PaletteID = &CartridgePaletteIDs[ GPUTextureID ];
+        TextureScale = CartridgeTextureScales[ GPUTextureID ];
+    }
+    
+    // create a new OpenGL texture and select it
     glGenTextures( 1, OpenGLTextureID );
-    glBindTexture( GL_TEXTURE_2D, *OpenGLTextureID );
+    BindTexture( *OpenGLTextureID );
     
     // check correct texture ID
     if( !OpenGLTextureID )
@@ -732,58 +2625,183 @@ void VideoOutput::LoadTexture( int GPUTextureID, void* Pixels )
     glGetError();
     
     // create an OpenGL texture from the received pixel data
-    glTexImage2D
+    if( Texture.IsPalettized )
+    {
+        // index rows are not aligned to 4 bytes
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+        
+        #if defined(HAVE_OPENGLES2)
+          const GLint IndexInternalFormat = GL_LUMINANCE;
+          const GLenum IndexFormat = GL_LUMINANCE;
+        #else
+          const GLint IndexInternalFormat = GL_R8;
+          const GLenum IndexFormat = GL_RED;
+        #endif
+        
+        glTexImage2D
+        (
+            GL_TEXTURE_2D,              // texture is a 2D rectangle
+            0,                          // level of detail (0 = normal size)
+            IndexInternalFormat,        // a single color component (the index)
+            Texture.StorageWidth,       // texture width in pixels
+            Texture.StorageHeight,      // texture height in pixels
+            0,                          // border width (must be 0 or 1)
+            IndexFormat,                // single component in the source
+            GL_UNSIGNED_BYTE,           // each index is a byte
+            Texture.Pixels.data()       // buffer storing the texture data
+        );
+        
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    }
+    
+    else glTexImage2D
     (
         GL_TEXTURE_2D,              // texture is a 2D rectangle
         0,                          // level of detail (0 = normal size)
         GL_RGBA,                    // color components in the texture
-        Constants::GPUTextureSize,  // texture width in pixels
-        Constants::GPUTextureSize,  // texture height in pixels
+        Texture.StorageWidth,       // texture width in pixels
+        Texture.StorageHeight,      // texture height in pixels
         0,                          // border width (must be 0 or 1)
         GL_RGBA,                    // color components in the source
         GL_UNSIGNED_BYTE,           // each color component is a byte
-        Pixels                      // buffer storing the texture data
+        Texture.Pixels.data()       // buffer storing the texture data
     );
     
     // check correct conversion
     if( glGetError() != GL_NO_ERROR )
-      THROW( "Could not create an OpenGL texture from pixel data" );
+    {
+        ReleaseTexture( *OpenGLTextureID );
+        return false;
+    }
     
     // textures must be scaled using only nearest neighbour
     glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );         
     glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
     
     // out-of-texture coordinates must clamp, not wrap
-    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GetTextureWrapMode( Texture.StorageWidth ) );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GetTextureWrapMode( Texture.StorageHeight ) );
+    
+    // vertices have coordinates for a 1024x1024 texture
+    TextureScale[ 0 ] = (GLfloat)Constants::GPUTextureSize / Texture.StorageWidth;
+    TextureScale[ 1 ] = (GLfloat)Constants::GPUTextureSize / Texture.StorageHeight;
+    
+    if( Texture.IsPalettized )
+      *PaletteID = CreatePaletteTexture( Texture.Palette );
+    
+    // (the palette is included)
+    FrameStatistics.TextureBytes += GetStoredTextureBytes( Texture );
+    TotalStatistics.TextureBytes += GetStoredTextureBytes( Texture );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+GLuint VideoOutput::CreatePaletteTexture( const uint32_t* Palette )
+{
+    GLuint PaletteID = 0;
+    glGenTextures( 1, &PaletteID );
+    BindTexture( PaletteID );
+    glGetError();
+    
+    glTexImage2D
+    (
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA,
+        256, 1,     // width, height
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        Palette
+    );
+    
+    if( glGetError() != GL_NO_ERROR )
+      THROW( "Could not create a palette texture" );
+    
+    // each index must read exactly one color
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    
+    return PaletteID;
 }
 
 // -----------------------------------------------------------------------------
 
 void VideoOutput::UnloadTexture( int GPUTextureID )
 {
+    TextureOpacityMap& Opacity = (GPUTextureID >= 0? CartridgeTextureOpacity[ GPUTextureID ] : BiosTextureOpacity);
+    memset( &Opacity, 0, sizeof( TextureOpacityMap ) );
+    
+    // (assigning an empty copy frees its memory)
+    LoadedTexture& Copy = (GPUTextureID >= 0? CartridgeTextureCopies[ GPUTextureID ] : BiosTextureCopy);
+    Copy = LoadedTexture();
+    
     if( GPUTextureID >= 0 )
-      ReleaseTexture( CartridgeTextureIDs[ GPUTextureID ] );
-    else
-      ReleaseTexture( BiosTextureID );
+      CartridgeTextureSources[ GPUTextureID ] = GPUTextureID;
+    
+    ReleaseTextureObjects( GPUTextureID );
 }
 
 // -----------------------------------------------------------------------------
 
-void VideoOutput::SelectTexture( int GPUTextureID )
+// releases the OpenGL objects for a texture but keeps
+// its copy, so it can be created again in a new context
+void VideoOutput::ReleaseTextureObjects( int GPUTextureID )
 {
-    // we must render any pending quads before
-    // applying any new render configurations
-    RenderQuadQueue();
-    
-    SelectedTexture = GPUTextureID;
-    GLuint* OpenGLTextureID = &BiosTextureID;
+    // with no context there are no objects, and
+    // texture array layers are just overwritten later
+    if( !IsInitialized || UseTextureArray )
+      return;
     
     if( GPUTextureID >= 0 )
-      OpenGLTextureID = &CartridgeTextureIDs[ GPUTextureID ];
+    {
+        if( TextureMemoryBudget )
+        {
+            if( CartridgeTextureIDs[ GPUTextureID ] )
+              ResidentTextureBytes -= GetStoredTextureBytes( CartridgeTextureData[ GPUTextureID ] );
+            
+            CartridgeTextureData[ GPUTextureID ] = StoredTexture();
+        }
+        
+        ReleaseTexture( CartridgeTextureIDs[ GPUTextureID ] );
+        ReleaseTexture( CartridgePaletteIDs[ GPUTextureID ] );
+    }
     
-    glBindTexture( GL_TEXTURE_2D, *OpenGLTextureID );
-    glEnable( GL_TEXTURE_2D );
+    else
+    {
+        ReleaseTexture( BiosTextureID );
+        ReleaseTexture( BiosPaletteID );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// the texture will be drawn with the source's OpenGL texture;
+// texture arrays cannot do this, since each layer (one per
+// texture) also selects the texture's region table (and
+// instancing will use texture arrays, even if this is
+// called before rendering is initialized)
+bool VideoOutput::ShareTexture( int GPUTextureID, int SourceTextureID )
+{
+    if( UseTextureArray || UseInstancing )
+      return false;
+    
+    UnloadTexture( GPUTextureID );
+    CartridgeTextureSources[ GPUTextureID ] = CartridgeTextureSources[ SourceTextureID ];
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+// the texture is bound when the next quad is queued; with
+// texture arrays, only the layer in each vertex changes
+void VideoOutput::SelectTexture( int GPUTextureID )
+{
+    SelectedTexture = GPUTextureID;
+    SelectedLayer = GPUTextureID + 1;
 }
 
 // -----------------------------------------------------------------------------
@@ -792,3 +2810,249 @@ int32_t VideoOutput::GetSelectedTexture()
 {
     return SelectedTexture;
 }
+
+// -----------------------------------------------------------------------------
+
+// called before loading cartridge textures, so that the
+// texture array can be sized once instead of growing
+void VideoOutput::ReserveCartridgeTextures( int NumberOfTextures )
+{
+    // (with no context, the array is sized when created)
+    ReservedCartridgeTextures = NumberOfTextures;
+    
+    if( !UseTextureArray || !IsInitialized )
+      return;
+    
+    // only the BIOS texture needs to be kept
+    if( TextureArrayLayers != NumberOfTextures + 1 )
+      ResizeTextureArray( NumberOfTextures + 1, 1, TextureArrayWidth, TextureArrayHeight );
+}
+
+// -----------------------------------------------------------------------------
+
+// creates a new texture array, copying the first
+// layers from the previous one if there was any
+void VideoOutput::ResizeTextureArray( int NewLayers, int KeptLayers, int NewWidth, int NewHeight )
+{
+    #if !defined(HAVE_OPENGLES2)
+      
+      LOG( "Resizing texture array to " + to_string( NewLayers ) + " layers of "
+         + to_string( NewWidth ) + "x" + to_string( NewHeight ) + " pixels" );
+      
+      // pending quads may still use the previous array
+      RenderQuadQueue( FlushReasons::TextureUpload );
+      ClearOpenGLErrors();
+      
+      GLuint NewTextureArrayID = 0;
+      glGenTextures( 1, &NewTextureArrayID );
+      glBindTexture( GL_TEXTURE_2D_ARRAY, NewTextureArrayID );
+      
+      glTexImage3D
+      (
+          GL_TEXTURE_2D_ARRAY,
+          0,                            // level of detail (0 = normal size)
+          GL_RGBA8,                     // color components in the texture
+          NewWidth,                     // width in pixels
+          NewHeight,                    // height in pixels
+          NewLayers,                    // number of layers
+          0,                            // border width (must be 0)
+          GL_RGBA,                      // color components in the source
+          GL_UNSIGNED_BYTE,             // each color component is a byte
+          nullptr                       // no data yet
+      );
+      
+      if( glGetError() != GL_NO_ERROR )
+        THROW( "Could not create a texture array with " + to_string( NewLayers ) + " layers" );
+      
+      // same configuration as for individual textures
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GetTextureWrapMode( NewWidth ) );
+      glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GetTextureWrapMode( NewHeight ) );
+      
+      // copy kept layers on the GPU, reading each
+      // one through a temporary framebuffer
+      KeptLayers = min( KeptLayers, min( TextureArrayLayers, NewLayers ) );
+      
+      if( TextureArrayID && KeptLayers > 0 )
+      {
+          // when layers get larger, the area around
+          // the copied pixels has to be transparent
+          int CopiedWidth = min( TextureArrayWidth, NewWidth );
+          int CopiedHeight = min( TextureArrayHeight, NewHeight );
+          
+          if( CopiedWidth != NewWidth || CopiedHeight != NewHeight )
+          {
+              vector< uint8_t > TransparentPixels( 4 * NewWidth * NewHeight, 0 );
+              
+              for( int Layer = 0; Layer < KeptLayers; Layer++ )
+                glTexSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, Layer, NewWidth, NewHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, TransparentPixels.data() );
+              
+              FrameStatistics.TextureBytes += KeptLayers * TransparentPixels.size();
+              TotalStatistics.TextureBytes += KeptLayers * TransparentPixels.size();
+          }
+          
+          GLuint CopyFramebuffer = 0;
+          glGenFramebuffers( 1, &CopyFramebuffer );
+          glBindFramebuffer( GL_READ_FRAMEBUFFER, CopyFramebuffer );
+          
+          for( int Layer = 0; Layer < KeptLayers; Layer++ )
+          {
+              glFramebufferTextureLayer( GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, TextureArrayID, 0, Layer );
+              glCopyTexSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, Layer, 0, 0, CopiedWidth, CopiedHeight );
+          }
+          
+          glDeleteFramebuffers( 1, &CopyFramebuffer );
+          RenderToFramebuffer();
+      }
+      
+      // replace the previous array
+      ReleaseTexture( TextureArrayID );
+      TextureArrayID = NewTextureArrayID;
+      TextureArrayLayers = NewLayers;
+      TextureArrayWidth = NewWidth;
+      TextureArrayHeight = NewHeight;
+      
+      // region tables must have the same layers
+      if( UseInstancing )
+        ResizeRegionTables( NewLayers );
+    
+    #endif
+}
+
+
+// =============================================================================
+//      VIDEO OUTPUT: TEXTURE RESIDENCY
+// =============================================================================
+
+
+// this needs to be set before initializing; a budget
+// of 0 keeps all textures in the GPU since they are
+// loaded, and it does not apply to texture arrays
+void VideoOutput::SetTextureMemoryBudget( uint64_t Bytes )
+{
+    if( IsInitialized )
+      return;
+    
+    TextureMemoryBudget = Bytes;
+}
+
+// -----------------------------------------------------------------------------
+
+uint64_t VideoOutput::GetStoredTextureBytes( const StoredTexture& Texture )
+{
+    uint64_t Pixels = (uint64_t)Texture.StorageWidth * Texture.StorageHeight;
+    return (Texture.IsPalettized? Pixels + 256 * 4 : 4 * Pixels);
+}
+
+// -----------------------------------------------------------------------------
+
+// uploads a cartridge texture that is about to be drawn,
+// first evicting the least recently used ones as needed
+// to fit the budget (or when the GPU runs out of memory)
+void VideoOutput::MakeTextureResident( int GPUTextureID )
+{
+    StoredTexture& Texture = CartridgeTextureData[ GPUTextureID ];
+    uint64_t TextureBytes = GetStoredTextureBytes( Texture );
+    
+    // evicted textures may be used by queued quads
+    RenderQuadQueue( FlushReasons::TextureUpload );
+    
+    while( ResidentTextureBytes + TextureBytes > TextureMemoryBudget )
+      if( !EvictLeastRecentTexture() )
+        break;
+    
+    while( !UploadTexture( GPUTextureID, Texture ) )
+      if( !EvictLeastRecentTexture() )
+        THROW( "Could not upload texture with ID = " + to_string( GPUTextureID ) + " to the GPU" );
+    
+    ResidentTextureBytes += TextureBytes;
+    
+    // uploading binds the texture without its scale
+    // or palette, so let it be bound again normally
+    BindTexture( 0 );
+    
+    // update metrics; any frame
+    // with uploads has a stall
+    FrameStatistics.TextureUploads++;
+    TotalStatistics.TextureUploads++;
+    
+    if( !FrameStatistics.TextureStalls )
+    {
+        FrameStatistics.TextureStalls++;
+        TotalStatistics.TextureStalls++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// returns false if no texture could be evicted
+bool VideoOutput::EvictLeastRecentTexture()
+{
+    int EvictedTexture = -1;
+    
+    for( int i = 0; i < Constants::GPUMaximumCartridgeTextures; i++ )
+    {
+        if( !CartridgeTextureIDs[ i ] )
+          continue;
+        
+        if( EvictedTexture < 0 || CartridgeTextureLastUse[ i ] < CartridgeTextureLastUse[ EvictedTexture ] )
+          EvictedTexture = i;
+    }
+    
+    if( EvictedTexture < 0 )
+      return false;
+    
+    // the palette may still be bound, and
+    // its ID could be reused by a new one
+    if( CartridgePaletteIDs[ EvictedTexture ] == AppliedPaletteID )
+      BindPalette( 0 );
+    
+    ReleaseTexture( CartridgeTextureIDs[ EvictedTexture ] );
+    ReleaseTexture( CartridgePaletteIDs[ EvictedTexture ] );
+    ResidentTextureBytes -= GetStoredTextureBytes( CartridgeTextureData[ EvictedTexture ] );
+    
+    // update metrics
+    FrameStatistics.TextureEvictions++;
+    TotalStatistics.TextureEvictions++;
+    return true;
+}
+
+
+// =============================================================================
+//      VIDEO OUTPUT: METRICS
+// =============================================================================
+
+
+void VideoOutput::SetErrorChecking( bool Enabled )
+{
+    CheckErrors = Enabled;
+}
+
+// -----------------------------------------------------------------------------
+
+VideoStatistics VideoOutput::GetLastFrameStatistics()
+{
+    return LastFrameStatistics;
+}
+
+// -----------------------------------------------------------------------------
+
+VideoStatistics VideoOutput::GetTotalStatistics()
+{
+    return TotalStatistics;
+}
+
+// -----------------------------------------------------------------------------
+
+unsigned VideoOutput::GetRenderedFrames()
+{
+    return RenderedFrames;
+}
+
+// -----------------------------------------------------------------------------
+
+TextureMemoryStatistics VideoOutput::GetTextureMemoryStatistics()
+{
+    return TextureMemory;
+}
@@ -12,13 +12,171 @@
     
     // include OpenGL headers
     #include "glsym/glsym.h"
+    
+    // include C/C++ headers
+    #include <vector>           // [ C++ STL ] Vectors
 // *****************************************************************************
 
 
 // we will render our quads in groups using a
 // fixed size queue; this parameter sets the
 // queue size and acts as group size limit
-#define QUAD_QUEUE_SIZE 20
+// (indices are 16-bit, so it must stay below 16384)
+#define QUAD_QUEUE_SIZE 4096
+
+// queued quads are written to consecutive regions of
+// a larger vertex buffer, which is only reallocated
+// when it gets full; size is given in quads
+#define QUAD_STREAM_SIZE (4 * QUAD_QUEUE_SIZE)
+
+// for instanced rendering, the regions of each texture
+// are stored in a table as 2 texels per region (bounds
+// and hotspot), placing this many regions in each row
+#define REGIONS_PER_TABLE_ROW 64
+
+// in retained batch mode, batches with at least this many
+// quads are kept in their own buffers for the next frame,
+// up to this number of batches per frame
+#define RETAINED_BATCH_MINIMUM_QUADS 32
+#define RETAINED_BATCH_SLOTS 16
+
+// to find quads that hide everything drawn before them,
+// textures are divided in square tiles of this many texels
+// and the tiles that are fully opaque are marked
+#define OPACITY_TILE_SIZE 8
+#define OPACITY_TILES_PER_ROW (V32::Constants::GPUTextureSize / OPACITY_TILE_SIZE)
+
+
+// =============================================================================
+//      RENDERING STATISTICS
+// =============================================================================
+
+
+// what caused each batch of queued quads to be drawn
+enum class FlushReasons: int
+{
+    QueueFull = 0,
+    TextureChange,
+    BlendingChange,
+    ScreenClear,
+    RegionTableChange,
+    TextureUpload,
+    FrameEnd
+};
+
+#define NUMBER_OF_FLUSH_REASONS 7
+
+// -----------------------------------------------------------------------------
+
+typedef struct
+{
+    unsigned Quads;
+    unsigned DrawCalls;
+    unsigned BufferOrphans;
+    unsigned StateChanges;
+    unsigned RetainedHits;
+    unsigned RetainedMisses;
+    unsigned TextureUploads;
+    unsigned TextureEvictions;
+    unsigned TextureStalls;     // frames that waited for uploads
+    unsigned OccludedQuads;     // discarded, hidden by a later quad
+    unsigned SkippedClears;
+    unsigned InvalidatedFrames; // previous contents not loaded
+    unsigned PreservedFrames;
+    unsigned Flushes[ NUMBER_OF_FLUSH_REASONS ];
+    unsigned TextureBinds;
+    uint64_t VertexBytes;       // sent to vertex buffers
+    uint64_t TextureBytes;      // sent to textures
+    unsigned OpenGLErrors;      // only when error checking is on
+}
+VideoStatistics;
+
+// -----------------------------------------------------------------------------
+
+typedef struct
+{
+    unsigned Textures;
+    unsigned PalettizedTextures;
+    uint64_t StoredBytes;
+    uint64_t SavedBytes;        // compared to storing all as RGBA
+}
+TextureMemoryStatistics;
+
+
+// =============================================================================
+//      TEXTURE STORAGE
+// =============================================================================
+
+
+// texture data as stored in the GPU (padded, and palettized
+// or premultiplied as needed); when textures can be evicted
+// from the GPU, it is kept in memory to upload them again
+typedef struct
+{
+    std::vector< uint8_t > Pixels;
+    uint32_t Palette[ 256 ];
+    int StorageWidth, StorageHeight;
+    bool IsPalettized;
+}
+StoredTexture;
+
+// -----------------------------------------------------------------------------
+
+// texture pixels as given by the console (RGBA, at their
+// real size); these are kept for all loaded textures, so
+// they can be created again after a context is lost
+typedef struct
+{
+    std::vector< uint8_t > Pixels;
+    int Width, Height;
+}
+LoadedTexture;
+
+// -----------------------------------------------------------------------------
+
+// 1 bit per tile, set when all of its texels are inside
+// the texture and have full alpha (see OPACITY_TILE_SIZE)
+typedef struct
+{
+    uint64_t TileRows[ OPACITY_TILES_PER_ROW ][ OPACITY_TILES_PER_ROW / 64 ];
+}
+TextureOpacityMap;
+
+
+// =============================================================================
+//      INSTANCED RENDERING
+// =============================================================================
+
+
+// compact data for a region drawing; the vertex
+// shader reads the region from the texture's table
+// and applies all transforms to produce the quad
+typedef struct
+{
+    GLshort DrawingPointX, DrawingPointY;
+    GLfloat DrawingScaleX, DrawingScaleY;
+    GLfloat AngleCos, AngleSin;
+    GLshort RegionID;           // -1 means a full screen quad
+    GLshort TextureLayer;
+    V32::GPUColor Color;
+}
+RegionInstance;
+
+
+// =============================================================================
+//      RETAINED BATCHES
+// =============================================================================
+
+
+// a batch drawn in the last frame; its vertices are kept
+// both in the GPU and here, to compare with the next one
+typedef struct
+{
+    GLuint VBO;
+    std::vector< GLfloat > Vertices;
+    int Quads;
+}
+RetainedBatch;
 
 
 // =============================================================================
@@ -30,22 +188,135 @@ class VideoOutput
 {
     private:
         
-        // arrays to hold buffer info
-        GLfloat QuadVerticesInfo[ 16 * QUAD_QUEUE_SIZE ];
+        // arrays to hold buffer info (sized for the
+        // largest vertex format, see ValuesPerVertex)
+        GLfloat QuadVerticesInfo[ 24 * QUAD_QUEUE_SIZE ];
         GLushort VertexIndices[ 6 * QUAD_QUEUE_SIZE ];
         
         // current color modifiers
         V32::GPUColor MultiplyColor;
         V32::IOPortValues BlendingMode;
         
+        // render state is only sent to OpenGL when the next
+        // quad is queued, so these keep what OpenGL has now
+        V32::IOPortValues AppliedBlendingMode;
+        GLuint BoundTextureID;
+        
+        // in premultiplied alpha mode, textures have their
+        // colors multiplied by alpha when loaded; additive
+        // quads are then drawn with the same blend function
+        // as alpha quads, by writing zero alpha as vertex color
+        bool UsePremultipliedAlpha;
+        
+        // the color actually written in queued vertices
+        V32::GPUColor VertexColor;
+        
         // OpenGL IDs of loaded textures
         GLuint BiosTextureID;
         GLuint CartridgeTextureIDs[ V32::Constants::GPUMaximumCartridgeTextures ];
         int32_t SelectedTexture;
         
+        // cartridge textures identical to a previous one are
+        // drawn with its OpenGL texture (this is the ID of the
+        // texture whose data is used, normally the same ID)
+        int32_t CartridgeTextureSources[ V32::Constants::GPUMaximumCartridgeTextures ];
+        
+        // textures can be loaded with no context (or before a
+        // context reset), so they are created from these copies
+        // when rendering is initialized
+        LoadedTexture BiosTextureCopy;
+        std::vector< LoadedTexture > CartridgeTextureCopies;
+        int ReservedCartridgeTextures;
+        
+        // opacity of texture areas, used to find quads
+        // that will hide anything drawn before them
+        TextureOpacityMap BiosTextureOpacity;
+        std::vector< TextureOpacityMap > CartridgeTextureOpacity;
+        
+        // opaque clears are only done when something else
+        // is drawn, so that they are skipped if a later quad
+        // or clear will overwrite the whole screen anyway
+        bool ClearPending;
+        V32::GPUColor PendingClearColor;
+        
+        // tile-based GPUs load the previous framebuffer at the
+        // start of each frame, unless told that it is not needed
+        // (i.e. the frame starts with a full screen clear or quad)
+        bool UseFramebufferInvalidation;
+        bool FrameDrawingStarted;
+        bool FrameCovered;
+        
+        // set when the first drawing of the frame overwrote
+        // all previous contents (see StartFrameDrawing)
+        bool FrameReplacedScreen;
+        
+        // reading OpenGL errors can stall some drivers,
+        // so it is only done when statistics are shown
+        bool CheckErrors;
+        
+        // textures are stored with a power of 2 size, and the
+        // shader scales vertex texture coordinates (which are
+        // given for 1024x1024) by these factors for each one
+        GLfloat BiosTextureScale[ 2 ];
+        GLfloat CartridgeTextureScales[ V32::Constants::GPUMaximumCartridgeTextures ][ 2 ];
+        GLfloat AppliedTextureScale[ 2 ];
+        
+        // in palette mode, textures with up to 256 colors are
+        // stored as 8-bit color indices, and the shader reads
+        // their colors from a 256x1 palette texture (this is
+        // not used with texture arrays)
+        bool UsePalettes;
+        GLuint BiosPaletteID;
+        GLuint CartridgePaletteIDs[ V32::Constants::GPUMaximumCartridgeTextures ];
+        GLuint AppliedPaletteID;
+        
+        // with a memory budget, cartridge textures are kept in
+        // memory and only uploaded to the GPU when drawn; the
+        // least recently drawn are evicted to fit the budget
+        uint64_t TextureMemoryBudget;
+        uint64_t ResidentTextureBytes;
+        std::vector< StoredTexture > CartridgeTextureData;
+        unsigned CartridgeTextureLastUse[ V32::Constants::GPUMaximumCartridgeTextures ];
+        
         // white texture used to draw solid colors
         GLuint WhiteTextureID;
         
+        // in texture array mode all textures are layers of
+        // a single GL object (BIOS is layer 0, cartridge
+        // textures follow), so selecting a texture only
+        // changes the layer written in the next vertices
+        bool UseTextureArray;
+        GLuint TextureArrayID;
+        int TextureArrayLayers;
+        int TextureArrayWidth, TextureArrayHeight;
+        GLfloat SelectedLayer;
+        
+        // in instanced mode regions are queued as instances,
+        // and a table with all regions of each texture is
+        // kept in the GPU (only changed rows are updated)
+        bool UseInstancing;
+        RegionInstance QueuedInstances[ QUAD_QUEUE_SIZE ];
+        std::vector< GLshort > RegionTables;
+        std::vector< int > FirstChangedRow;
+        std::vector< int > LastChangedRow;
+        bool RegionTablesChanged;
+        GLuint RegionTableID;
+        
+        // in retained batch mode, large batches are matched
+        // with those of the last frame in the same order; if
+        // one only differs by a translation, the kept vertices
+        // are drawn again with a position offset instead
+        bool UseRetainedBatches;
+        RetainedBatch RetainedBatches[ RETAINED_BATCH_SLOTS ];
+        int NextRetainedBatch;
+        GLfloat PositionOffsetX, PositionOffsetY;
+        bool StreamAttributesChanged;
+        
+        // vertices have x,y,tex_x,tex_y, the multiply
+        // color packed as RGBA8 and, when using a texture
+        // array, the texture layer (all take 4 bytes)
+        int ValuesPerVertex;
+        
         // additional GL objects
         GLuint VAO;
         GLuint VBOVertexInfo;
@@ -55,11 +326,29 @@ class VideoOutput
         
         // rendering control for quad groups
         int QueuedQuads;
+        GLintptr StreamOffset;
+        
+        // rendering metrics
+        VideoStatistics FrameStatistics;
+        VideoStatistics LastFrameStatistics;
+        VideoStatistics TotalStatistics;
+        unsigned RenderedFrames;
+        TextureMemoryStatistics TextureMemory;
         
         // positions of shader parameters
         GLuint VertexInfoLocation;
+        GLuint VertexColorLocation;
+        GLuint VertexLayerLocation;
+        GLuint InstancePointLocation;
+        GLuint InstanceTransformLocation;
+        GLuint InstanceRegionLocation;
+        GLuint InstanceColorLocation;
         GLuint TextureUnitLocation;
-        GLuint MultiplyColorLocation;
+        GLuint RegionTableLocation;
+        GLuint PositionOffsetLocation;
+        GLuint TextureScaleLocation;
+        GLuint PaletteUnitLocation;
+        GLuint UsePaletteLocation;
         
     public:
         
@@ -71,29 +360,91 @@ class VideoOutput
         bool CompileShaderProgram();
         void CreateWhiteTexture();
         void ReleaseTexture( GLuint& OpenGLTextureID );
+        void SetTextureArrayMode( bool Enabled );
+        void SetPremultipliedAlphaMode( bool Enabled );
+        void SetInstancingMode( bool Enabled );
+        bool IsInstancingEnabled();
+        void SetRetainedBatchMode( bool Enabled );
+        void SetPaletteMode( bool Enabled );
         void InitRendering();
+        void SetVertexAttributes( GLintptr Offset );
         void Destroy();
         
         // framebuffer render functions
         void RenderToFramebuffer();
         void BeginFrame();
+        void EndFrame();
+        void StartFrameDrawing();
+        void InvalidateFramebuffer();
+        bool IsFrameRepeatable();
         
         // color control functions
         void SetMultiplyColor( V32::GPUColor NewMultiplyColor );
         V32::GPUColor GetMultiplyColor();
         void SetBlendingMode( V32::IOPortValues BlendingMode );
         V32::IOPortValues GetBlendingMode();
+        void ApplyBlendingMode();
+        V32::GPUColor CalculateVertexColor( V32::GPUColor Color );
+        void UpdateVertexColor();
+        
+        // render state functions
+        void ApplyRenderState();
+        void ApplyPendingBlending();
+        void BindTexture( GLuint OpenGLTextureID );
+        void SetTextureScale( GLfloat ScaleX, GLfloat ScaleY );
+        void BindPalette( GLuint PaletteID );
         
         // render functions
         void ClearScreen( V32::GPUColor ClearColor );
         void AddQuadToQueue( const V32::GPUQuad& Quad );
-        void RenderQuadQueue();
+        void QueueQuad( const V32::GPUQuad& Quad, V32::GPUColor Color, GLfloat Layer );
+        void AddRegionToQueue( const V32::GPURegionDrawing& Drawing );
+        void RenderQuadQueue( FlushReasons Reason );
+        void RenderInstanceQueue();
+        GLintptr WriteToVertexStream( const void* Data, GLsizeiptr Size );
+        
+        // occlusion functions
+        void UpdateTextureOpacity( int GPUTextureID, const void* Pixels, int Width, int Height );
+        bool IsTextureAreaOpaque( int GPUTextureID, int MinX, int MinY, int MaxX, int MaxY );
+        bool IsOcclusionUseful();
+        bool IsOccludingQuad( const V32::GPUQuad& Quad );
+        void DiscardOccludedDrawing();
+        void ApplyPendingClear();
+        
+        // retained batch functions
+        bool RenderRetainedBatch();
+        bool MatchesRetainedBatch( const RetainedBatch& Batch, GLfloat& OffsetX, GLfloat& OffsetY );
+        void SetPositionOffset( GLfloat OffsetX, GLfloat OffsetY );
         
         // texture handling
-        void LoadTexture( int GPUTextureID, void* Pixels );
+        void LoadTexture( int GPUTextureID, void* Pixels, int Width, int Height );
+        void CreateTexture( int GPUTextureID );
+        void RecreateTextures();
+        void PrepareTexture( const void* Pixels, int Width, int Height, int StorageWidth, int StorageHeight, StoredTexture& Texture );
+        bool UploadTexture( int GPUTextureID, const StoredTexture& Texture );
+        GLuint CreatePaletteTexture( const uint32_t* Palette );
         void UnloadTexture( int GPUTextureID );
+        void ReleaseTextureObjects( int GPUTextureID );
+        bool ShareTexture( int GPUTextureID, int SourceTextureID );
         void SelectTexture( int GPUTextureID );
         int32_t GetSelectedTexture();
+        void ReserveCartridgeTextures( int NumberOfTextures );
+        void ResizeTextureArray( int NewLayers, int KeptLayers, int NewWidth, int NewHeight );
+        void ResizeRegionTables( int NewLayers );
+        void UpdateRegionTables();
+        
+        // texture residency
+        void SetTextureMemoryBudget( uint64_t Bytes );
+        uint64_t GetStoredTextureBytes( const StoredTexture& Texture );
+        void MakeTextureResident( int GPUTextureID );
+        bool EvictLeastRecentTexture();
+        
+        // metrics
+        void SetErrorChecking( bool Enabled );
+        VideoStatistics GetLastFrameStatistics();
+        VideoStatistics GetTotalStatistics();
+        unsigned GetRenderedFrames();
+        TextureMemoryStatistics GetTextureMemoryStatistics();
 };
 
 
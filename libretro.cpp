@@ -11,6 +11,11 @@
     
     // include emulator headers
     #include "VideoOutput.hpp"
+    #include "SoftwareRenderer.hpp"
+    #include "EmulationThread.hpp"
+    #include "AudioOutput.hpp"
+    #include "AudioResampler.hpp"
+    #include "CaptureOutput.hpp"
     #include "Globals.hpp"
     #include "Logging.hpp"
     #include "Savestates.hpp"
@@ -23,6 +28,10 @@
     #include <math.h>
     #include <time.h>
     #include <sstream>
+    #include <atomic>
+    #include <algorithm>
+    #include <thread>
+    #include <chrono>
     
     // include the autogenerated embedded bios file
     #include <embedded/StandardBios.h>
@@ -170,15 +179,218 @@ void configure_frameskip()
 }
 
 
+// =============================================================================
+//      HANDLING AUDIO CALLBACK MODE
+// =============================================================================
+
+
+// internal configuration variable
+// (only applied when a game is loaded)
+bool enable_audio_callback = false;
+
+// state of the audio callback mode: when active, the
+// front-end pulls samples from our ring buffer from its
+// own audio thread instead of us pushing them each frame
+bool audio_callback_active = false;
+std::atomic< bool > audio_callback_enabled( false );
+
+// samples sent to the front-end in each audio callback
+#define AUDIO_CALLBACK_CHUNK 512
+
+// on underrun we send a short silence instead of
+// returning nothing, to avoid a busy audio thread
+#define AUDIO_CALLBACK_SILENCE 128
+
+// -----------------------------------------------------------------------------
+
+// called by the front-end from its audio thread
+static void retro_audio_callback_cb()
+{
+    static V32::SPUSample Chunk[ AUDIO_CALLBACK_CHUNK ];
+    static const V32::SPUSample Silence[ AUDIO_CALLBACK_SILENCE ] = {};
+    
+    // send all samples that are currently available
+    unsigned Available = Audio.GetOccupancy();
+    
+    if( !Available )
+    {
+        // the ring is left untouched, in case the
+        // producer adds samples in the meantime
+        Audio.CountUnderrun();
+        audio_batch_cb( (const int16_t*)Silence, AUDIO_CALLBACK_SILENCE );
+        return;
+    }
+    
+    while( Available > 0 )
+    {
+        unsigned Popped = Audio.PopSamples( Chunk, min( Available, (unsigned)AUDIO_CALLBACK_CHUNK ) );
+        audio_batch_cb( (const int16_t*)Chunk, Popped );
+        Available -= Popped;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// called by the front-end when audio output starts or stops
+static void retro_audio_set_state_cb( bool enabled )
+{
+    audio_callback_enabled = enabled;
+}
+
+// -----------------------------------------------------------------------------
+
+// this needs to be done when loading a game
+void configure_audio_callback()
+{
+    struct retro_audio_callback audio_callback;
+    audio_callback.callback = retro_audio_callback_cb;
+    audio_callback.set_state = retro_audio_set_state_cb;
+    
+    audio_callback_active = false;
+    audio_callback_enabled = false;
+    Audio.Clear();
+    Audio.ResetStatistics();
+    
+    if( !enable_audio_callback )
+      return;
+    
+    // some front-ends might not support this
+    if( !environ_cb( RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, &audio_callback ) )
+    {
+        LOG( "Audio callback mode has been disabled because frontend does not support it." );
+        return;
+    }
+    
+    LOG( "Audio callback mode is active" );
+    audio_callback_active = true;
+}
+
+// -----------------------------------------------------------------------------
+
+// sends the audio of the last frame to the front-end
+void output_frame_audio()
+{
+    Console.GetFrameSoundOutput( AudioBuffer );
+    
+    // convert to the front-end's output rate
+    unsigned OutputCount = 0;
+    const V32::SPUSample* OutputSamples = Resampler.Process( AudioBuffer.Samples, V32::Constants::SPUSamplesPerFrame, OutputCount );
+    
+    // in callback mode just leave the samples in the ring;
+    // while front-end audio is stopped they are discarded
+    if( audio_callback_active )
+    {
+        if( audio_callback_enabled )
+          Audio.PushSamples( OutputSamples, OutputCount );
+    }
+    
+    else if( OutputCount > 0 )
+      audio_batch_cb( (const int16_t*)OutputSamples, OutputCount );
+}
+
+// -----------------------------------------------------------------------------
+
+void log_audio_statistics()
+{
+    // CPU cost of the SPU mixer, compared to the
+    // time available for each frame (1/60 s)
+    V32::SPUMixingStatistics Mixing = Console.SPU.GetMixingStatistics();
+    
+    if( Mixing.MixedFrames > 0 )
+    {
+        double FrameMicroseconds = Mixing.MixingNanoseconds / 1000.0 / Mixing.MixedFrames;
+        double FrameBudgetMicroseconds = 1000000.0 / V32::Constants::FramesPerSecond;
+        
+        LOG( string("SPU mixer statistics (sound compression ") + (Console.SPU.CompressSounds? "enabled" : "disabled") + "):" );
+        LOG( "    Mixed " + to_string( Mixing.MixedFrames ) + " frames, decoded " + to_string( Mixing.DecodedSamples ) + " compressed samples" );
+        LOG( "    CPU time: " + to_string( FrameMicroseconds ) + " us per frame (" + to_string( 100 * FrameMicroseconds / FrameBudgetMicroseconds ) + "% of frame time)" );
+    }
+    
+    // CPU cost of our own resampling, normalized
+    // to make it comparable between output rates
+    ResamplerStatistics Resampling = Resampler.GetStatistics();
+    
+    if( Resampling.InputSamples > 0 )
+    {
+        double AudioSeconds = (double)Resampling.InputSamples / V32::Constants::SPUSamplingRate;
+        double ProcessingMilliseconds = Resampling.ProcessingNanoseconds / 1000000.0;
+        
+        LOG( "Audio resampler statistics:" );
+        LOG( "    Converted " + to_string( Resampling.InputSamples ) + " samples to " + to_string( Resampling.OutputSamples ) + " samples" );
+        LOG( "    CPU time: " + to_string( ProcessingMilliseconds / AudioSeconds ) + " ms per second of audio" );
+        LOG( "    CPU time: " + to_string( Resampling.ProcessingNanoseconds / 1000.0 / Resampling.ProcessedCalls ) + " us per frame" );
+    }
+    
+    if( !audio_callback_active )
+      return;
+    
+    AudioRingStatistics Statistics = Audio.GetStatistics();
+    
+    LOG( "Audio ring buffer statistics:" );
+    LOG( "    Capacity: " + to_string( Statistics.Capacity ) + " samples" );
+    LOG( "    Occupancy: " + to_string( Statistics.CurrentOccupancy ) + " samples (min " + to_string( Statistics.MinimumOccupancy )
+       + ", max " + to_string( Statistics.MaximumOccupancy ) + ")" );
+    LOG( "    Underruns: " + to_string( Statistics.Underruns ) );
+    LOG( "    Dropped samples: " + to_string( Statistics.DroppedSamples ) );
+}
+
+
 // =============================================================================
 //      HANDLING CORE-SPECIFIC OPTIONS
 // =============================================================================
 
 
+// internal configuration variables
+// (only applied when a game is loaded)
+bool enable_capture = false;
+bool enable_texture_array = false;
+bool enable_premultiplied_alpha = false;
+bool enable_instanced_rendering = false;
+bool enable_retained_batches = false;
+bool enable_palettized_textures = true;
+unsigned texture_memory_budget = 0;         // in MB, 0 = unlimited
+bool enable_software_renderer = false;
+bool enable_threaded_rendering = false;
+bool enable_duplicate_frames = false;
+unsigned software_renderer_threads = 0;     // 0 = automatic
+
+// -----------------------------------------------------------------------------
+
+// internal configuration variables for audio output
+int audio_output_rate = V32::Constants::SPUSamplingRate;
+ResamplerQualities audio_resampler_quality = ResamplerQualities::Sinc;
+
+// -----------------------------------------------------------------------------
+
+// periodic video statistics (applied immediately),
+// and the totals at the time of the last report
+bool report_video_statistics = false;
+bool show_video_statistics = false;
+unsigned reported_video_frames = 0;
+VideoStatistics reported_video_statistics;
+
+// -----------------------------------------------------------------------------
+
 // configuration variables for this core
 struct retro_variable config_variables[] =
 {
     { "vircon32_enable_frameskip", "Automatic frame skip; Disabled|Enabled" },
+    { "vircon32_compress_sounds", "Compress sounds in memory (needs restart); Disabled|Enabled" },
+    { "vircon32_audio_callback", "Audio callback mode (needs restart); Disabled|Enabled" },
+    { "vircon32_audio_output_rate", "Audio output rate in Hz (needs restart); 44100|48000|32000|22050" },
+    { "vircon32_audio_resampler", "Audio resampler quality; Sinc|Linear" },
+    { "vircon32_capture", "Capture video and audio to save directory (needs restart); Disabled|Enabled" },
+    { "vircon32_texture_array", "Batch texture changes using a texture array (needs restart); Disabled|Enabled" },
+    { "vircon32_premultiplied_alpha", "Batch alpha and additive blending using premultiplied alpha (needs restart); Disabled|Enabled" },
+    { "vircon32_instanced_rendering", "Transform sprites on the GPU with instanced rendering (needs restart); Disabled|Enabled" },
+    { "vircon32_retained_batches", "Reuse geometry of large batches that only move between frames (needs restart); Disabled|Enabled" },
+    { "vircon32_palettized_textures", "Store textures with up to 256 colors using palettes (needs restart); Enabled|Disabled" },
+    { "vircon32_texture_memory_budget", "Texture memory budget in MB (needs restart); Unlimited|256|128|64|32" },
+    { "vircon32_renderer", "Renderer (needs restart); Hardware|Software" },
+    { "vircon32_software_threads", "Software renderer threads (needs restart); Auto|1|2|3|4|6|8" },
+    { "vircon32_threaded_rendering", "Emulate next frame while drawing, adds 1 frame of latency (needs restart); Disabled|Enabled" },
+    { "vircon32_skip_duplicate_frames", "Skip drawing of repeated frames (needs restart); Disabled|Enabled" },
+    { "vircon32_video_statistics", "Report video statistics every 5 seconds; Disabled|Log|Log and screen" },
     { nullptr, nullptr }
 };
 
@@ -199,6 +411,156 @@ static void update_config_variables()
         
         configure_frameskip();
     }
+    
+    // sound compression only applies to sounds loaded after the change
+    variable_state.key = "vircon32_compress_sounds";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+    {
+        bool compress_sounds = !strcmp( variable_state.value, "Enabled" );
+        
+        // the emulation thread may be using the SPU
+        Emulation.WaitForFrame();
+        
+        if( compress_sounds != Console.SPU.CompressSounds )
+          LOG( string("Sound compression ") + (compress_sounds? "enabled" : "disabled" ) );
+        
+        Console.SPU.CompressSounds = compress_sounds;
+    }
+    
+    // audio callback mode only applies to games loaded after the change
+    variable_state.key = "vircon32_audio_callback";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_audio_callback = !strcmp( variable_state.value, "Enabled" );
+    
+    // output rate only applies to games loaded after the change,
+    // since the front-end reads it along with the AV info
+    variable_state.key = "vircon32_audio_output_rate";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      audio_output_rate = atoi( variable_state.value );
+    
+    if( audio_output_rate <= 0 )
+      audio_output_rate = V32::Constants::SPUSamplingRate;
+    
+    // resampler quality can be changed at any time
+    variable_state.key = "vircon32_audio_resampler";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+    {
+        ResamplerQualities quality = ResamplerQualities::Sinc;
+        
+        if( !strcmp( variable_state.value, "Linear" ) )
+          quality = ResamplerQualities::Linear;
+        
+        if( quality != audio_resampler_quality )
+        {
+            audio_resampler_quality = quality;
+            Resampler.Configure( Resampler.GetOutputRate(), audio_resampler_quality );
+            LOG( string("Audio resampler quality set to ") + variable_state.value );
+        }
+    }
+    
+    // capture only applies to games loaded after the change
+    variable_state.key = "vircon32_capture";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_capture = !strcmp( variable_state.value, "Enabled" );
+    
+    // texture array mode only applies when the GL context is created
+    variable_state.key = "vircon32_texture_array";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_texture_array = !strcmp( variable_state.value, "Enabled" );
+    
+    // premultiplied alpha needs textures to be converted on load
+    variable_state.key = "vircon32_premultiplied_alpha";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_premultiplied_alpha = !strcmp( variable_state.value, "Enabled" );
+    
+    // instanced rendering changes shaders and console callbacks
+    variable_state.key = "vircon32_instanced_rendering";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_instanced_rendering = !strcmp( variable_state.value, "Enabled" );
+    
+    // retained batches need buffers created with the GL context
+    variable_state.key = "vircon32_retained_batches";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_retained_batches = !strcmp( variable_state.value, "Enabled" );
+    
+    // palettes are created when textures are loaded
+    variable_state.key = "vircon32_palettized_textures";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_palettized_textures = !strcmp( variable_state.value, "Enabled" );
+    
+    // the budget is applied when textures are loaded
+    variable_state.key = "vircon32_texture_memory_budget";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      texture_memory_budget = atoi( variable_state.value );
+    
+    // the software renderer replaces the OpenGL context
+    variable_state.key = "vircon32_renderer";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_software_renderer = !strcmp( variable_state.value, "Software" );
+    
+    // threads are created when the software renderer starts
+    variable_state.key = "vircon32_software_threads";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      software_renderer_threads = atoi( variable_state.value );
+    
+    // the emulation thread is started along with the GL context
+    variable_state.key = "vircon32_threaded_rendering";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_threaded_rendering = !strcmp( variable_state.value, "Enabled" );
+    
+    // duplicate frames need video commands to be recorded
+    variable_state.key = "vircon32_skip_duplicate_frames";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+      enable_duplicate_frames = !strcmp( variable_state.value, "Enabled" );
+    
+    // reports start counting from the moment they are enabled
+    variable_state.key = "vircon32_video_statistics";
+    variable_state.value = nullptr;
+    
+    if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE, &variable_state ) && variable_state.value )
+    {
+        bool was_reporting = report_video_statistics;
+        report_video_statistics = strcmp( variable_state.value, "Disabled" );
+        show_video_statistics = !strcmp( variable_state.value, "Log and screen" );
+        
+        if( report_video_statistics && !was_reporting )
+        {
+            reported_video_frames = Video.GetRenderedFrames();
+            reported_video_statistics = Video.GetTotalStatistics();
+        }
+        
+        Video.SetErrorChecking( report_video_statistics );
+    }
 }
 
 
@@ -209,6 +571,9 @@ static void update_config_variables()
 
 void retro_set_controller_port_device( unsigned port, unsigned device )
 {
+    // the console can only be accessed
+    // while no frame is being emulated
+    Emulation.WaitForFrame();
     Console.SetGamepadConnection( port, (device == RETRO_DEVICE_JOYPAD) );
 }
 
@@ -229,7 +594,7 @@ void retro_get_system_av_info( struct retro_system_av_info *info )
 {
     // video and audio frequencies
     info->timing.fps = 60;
-    info->timing.sample_rate = 44100.0;
+    info->timing.sample_rate = Resampler.GetOutputRate();
     
     // screen resolution is fixed 
     info->geometry.base_width  = V32::Constants::ScreenWidth;
@@ -273,6 +638,170 @@ void retro_set_environment( retro_environment_t cb )
 // =============================================================================
 
 
+// reads input for all connected gamepads
+void read_gamepad_input()
+{
+    input_poll_cb();
+    
+    for( int Port = 0; Port < V32::Constants::GamepadPorts; Port++ )
+    {
+        if( !Console.HasGamepad( Port ) )
+          continue;
+        
+        // read all controls
+        Console.SetGamepadControl( Port, V32::GamepadControls::Left,        input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT  ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::Right,       input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::Up,          input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP    ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::Down,        input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN  ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonStart, input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonA,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A     ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonB,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B     ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonX,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_X     ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonY,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y     ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonL,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L     ) );
+        Console.SetGamepadControl( Port, V32::GamepadControls::ButtonR,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R     ) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// state for detection of duplicate frames
+bool skip_duplicate_frames = false;
+bool last_frame_valid = false;
+uint64_t last_frame_hash = 0;
+
+// -----------------------------------------------------------------------------
+
+// the number of rendered frames between reports
+#define VIDEO_STATISTICS_INTERVAL 300
+
+// in the same order as FlushReasons
+const char* flush_reason_names[ NUMBER_OF_FLUSH_REASONS ] =
+{
+    "queue full", "texture", "blending", "clear", "regions", "upload", "frame end"
+};
+
+// shows averages per frame since the last report,
+// in the log and optionally as a front-end message
+void report_periodic_video_statistics()
+{
+    unsigned Frames = Video.GetRenderedFrames() - reported_video_frames;
+    
+    if( UseSoftwareRendering || Frames < VIDEO_STATISTICS_INTERVAL )
+      return;
+    
+    VideoStatistics Total = Video.GetTotalStatistics();
+    const VideoStatistics& Last = reported_video_statistics;
+    double KBSent = (double)(Total.VertexBytes - Last.VertexBytes + Total.TextureBytes - Last.TextureBytes) / 1024;
+    
+    char Report[ 300 ];
+    int Length = snprintf
+    (
+        Report, sizeof( Report ),
+        "Per frame: %.1f draw calls, %.1f quads, %.1f texture binds, %.1f KB sent; flushes:",
+        (double)(Total.DrawCalls - Last.DrawCalls) / Frames,
+        (double)(Total.Quads - Last.Quads) / Frames,
+        (double)(Total.TextureBinds - Last.TextureBinds) / Frames,
+        KBSent / Frames
+    );
+    
+    for( int i = 0; i < NUMBER_OF_FLUSH_REASONS; i++ )
+      Length += snprintf
+      (
+          Report + Length, sizeof( Report ) - Length, "%s %s %.1f", (i? "," : ""),
+          flush_reason_names[ i ], (double)(Total.Flushes[ i ] - Last.Flushes[ i ]) / Frames
+      );
+    
+    snprintf( Report + Length, sizeof( Report ) - Length, "; GL errors: %u", Total.OpenGLErrors - Last.OpenGLErrors );
+    LOG( Report );
+    
+    if( show_video_statistics )
+    {
+        struct retro_message Message = { Report, VIDEO_STATISTICS_INTERVAL };
+        environ_cb( RETRO_ENVIRONMENT_SET_MESSAGE, &Message );
+    }
+    
+    reported_video_frames += Frames;
+    reported_video_statistics = Total;
+}
+
+// -----------------------------------------------------------------------------
+
+// frames are recorded and then replayed with OpenGL; with
+// the emulation thread, each call presents the frame
+// emulated during the previous call, while the next one
+// is emulated (audio is delayed too, to stay in sync)
+void run_recorded_frame( bool DrawFrame )
+{
+    // the console can only be accessed
+    // while no frame is being emulated
+    Emulation.WaitForFrame();
+    
+    if( DrawFrame )
+    {
+        read_gamepad_input();
+        
+        if( !Console.IsPowerOn() )
+          Console.SetPower( true );
+    }
+    
+    // when no frame was emulated ahead (not threaded,
+    // at start, or after a reset or load) do one now
+    if( !Emulation.HasFinishedFrame() )
+    {
+        Emulation.StartFrame();
+        Emulation.WaitForFrame();
+    }
+    
+    output_frame_audio();
+    VideoCommandList& Commands = Emulation.TakeFinishedFrame();
+    
+    // start the next frame before drawing this one
+    if( Emulation.IsThreaded() )
+      Emulation.StartFrame();
+    
+    // for skipped frames only keep render state
+    if( !DrawFrame )
+    {
+        Commands.Replay( Video, false );
+        Capture.CaptureSkippedFrame( AudioBuffer );
+        return;
+    }
+    
+    // a frame identical to the last one is not drawn, and
+    // the front-end shows the last one again (render state
+    // would not change either, so nothing is replayed); this
+    // is not valid when the last frame was drawn on top of the
+    // previous contents, since drawing it again would change
+    // the image (see VideoOutput::IsFrameRepeatable)
+    if( skip_duplicate_frames && !Capture.IsActive() )
+    {
+        uint64_t FrameHash = Commands.CalculateHash( Video );
+        
+        if( last_frame_valid && FrameHash == last_frame_hash && Video.IsFrameRepeatable() )
+        {
+            video_cb( nullptr, V32::Constants::ScreenWidth, V32::Constants::ScreenHeight, 0 );
+            Emulation.FramePresented( true );
+            return;
+        }
+        
+        last_frame_hash = FrameHash;
+        last_frame_valid = true;
+    }
+    
+    Video.BeginFrame();
+    Commands.Replay( Video, true );
+    Video.EndFrame();
+    
+    if( Capture.IsActive() )
+      Capture.CaptureRenderedFrame( hw_render.get_current_framebuffer(), AudioBuffer );
+    
+    video_cb( RETRO_HW_FRAME_BUFFER_VALID, V32::Constants::ScreenWidth, V32::Constants::ScreenHeight, 0 );
+    Emulation.FramePresented( false );
+}
+
+// -----------------------------------------------------------------------------
+
 void retro_run()
 {
     // if config variables have changed, update them
@@ -281,50 +810,58 @@ void retro_run()
     if( environ_cb( RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &variables_changed ) && variables_changed )
       update_config_variables();
     
+    if( report_video_statistics )
+      report_periodic_video_statistics();
+    
     // determine if this frame will be skipped
     bool skip_frame = enable_frameskip && audio_buffer_active && audio_buffer_underrun_likely;
     
+    if( Emulation.IsRunning() )
+    {
+        run_recorded_frame( !skip_frame );
+        return;
+    }
+    
     // when possible, run a full frame
     if( !skip_frame )
     {
-        // read input for all connected gamepads
-        input_poll_cb();
-        
-        for( int Port = 0; Port < V32::Constants::GamepadPorts; Port++ )
-        {
-            if( !Console.HasGamepad( Port ) )
-              continue;
-            
-            // read all controls
-            Console.SetGamepadControl( Port, V32::GamepadControls::Left,        input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT  ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::Right,       input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::Up,          input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP    ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::Down,        input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN  ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonStart, input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonA,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A     ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonB,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B     ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonX,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_X     ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonY,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y     ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonL,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L     ) );
-            Console.SetGamepadControl( Port, V32::GamepadControls::ButtonR,     input_state_cb( Port, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R     ) );
-        }
+        read_gamepad_input();
         
         // run the console
         if( !Console.IsPowerOn() )
           Console.SetPower( true );
         
-        Video.BeginFrame();
-        Console.RunNextFrame( false );
-        
-        // ensure that all queued quads are rendered
-        Video.RenderQuadQueue();
+        if( UseSoftwareRendering )
+        {
+            Console.RunNextFrame( false );
+            
+            // render all of the frame's draws and send it
+            SoftwareVideo.RenderFrame();
+            video_cb( SoftwareVideo.GetFrame(), V32::Constants::ScreenWidth, V32::Constants::ScreenHeight, V32::Constants::ScreenWidth * 4 );
+        }
         
-        // send this frame's video signal to libretro
-        video_cb( RETRO_HW_FRAME_BUFFER_VALID, V32::Constants::ScreenWidth, V32::Constants::ScreenHeight, 0 );        
+        else
+        {
+            Video.BeginFrame();
+            Console.RunNextFrame( false );
+            
+            // ensure that all queued quads are rendered
+            Video.EndFrame();
+            
+            // when capturing, read the frame before the
+            // front-end gets the framebuffer
+            if( Capture.IsActive() )
+            {
+                Console.GetFrameSoundOutput( AudioBuffer );
+                Capture.CaptureRenderedFrame( hw_render.get_current_framebuffer(), AudioBuffer );
+            }
+            
+            // send this frame's video signal to libretro
+            video_cb( RETRO_HW_FRAME_BUFFER_VALID, V32::Constants::ScreenWidth, V32::Constants::ScreenHeight, 0 );
+        }
         
         // send this frame's audio signal to libretro
-        Console.GetFrameSoundOutput( AudioBuffer );
-        audio_batch_cb( (const int16_t*)AudioBuffer.Samples, V32::Constants::SPUSamplesPerFrame );
+        output_frame_audio();
     }
     
     // when a frame is skipped, only generate audio
@@ -335,8 +872,8 @@ void retro_run()
         Console.RunNextFrame( false );
         
         // send this frame's audio signal to libretro
-        Console.GetFrameSoundOutput( AudioBuffer );
-        audio_batch_cb( (const int16_t*)AudioBuffer.Samples, V32::Constants::SPUSamplesPerFrame );
+        output_frame_audio();
+        Capture.CaptureSkippedFrame( AudioBuffer );
     }
 }
 
@@ -393,6 +930,130 @@ string GetMemoryCardPath( const string& CartridgePath )
       return SaveDirectoryUnified + "/" + FileName.substr( 0, DotPosition ) + ".memc";
 }
 
+// -----------------------------------------------------------------------------
+
+// captures go to the save directory, named after the
+// game and the current time, so they never overwrite
+string GetCaptureBasePath( const string& CartridgePath )
+{
+    string BasePath = GetMemoryCardPath( CartridgePath );
+    BasePath = BasePath.substr( 0, BasePath.rfind( '.' ) );
+    
+    // with no game, the console runs the BIOS
+    if( CartridgePath.empty() )
+      BasePath += "Vircon32Bios";
+    
+    char TimeText[ 32 ];
+    time_t CurrentTime = time( nullptr );
+    strftime( TimeText, sizeof( TimeText ), "-%Y%m%d-%H%M%S", localtime( &CurrentTime ) );
+    return BasePath + TimeText;
+}
+
+
+// =============================================================================
+//      SESSION STATISTICS AND CAPTURE
+// =============================================================================
+
+
+void log_video_statistics()
+{
+    if( UseSoftwareRendering )
+    {
+        unsigned Frames = SoftwareVideo.GetRenderedFrames();
+        SoftwareStatistics Statistics = SoftwareVideo.GetTotalStatistics();
+        
+        if( !Frames )
+          return;
+        
+        LOG( "Software renderer statistics:" );
+        LOG( "    Threads: " + to_string( SoftwareVideo.GetNumberOfThreads() ) );
+        LOG( "    Rendered frames: " + to_string( Frames ) );
+        LOG( "    Quads per frame: " + to_string( (double)Statistics.Quads / Frames ) );
+        LOG( "    Render time per frame: " + to_string( Statistics.RenderMilliseconds / Frames ) + " ms" );
+        return;
+    }
+    
+    unsigned Frames = Video.GetRenderedFrames();
+    VideoStatistics Statistics = Video.GetTotalStatistics();
+    
+    if( !Frames || !Statistics.DrawCalls )
+      return;
+    
+    LOG( "Video statistics:" );
+    LOG( "    Frames: " + to_string( Frames ) );
+    LOG( "    Quads per frame: " + to_string( (double)Statistics.Quads / Frames ) );
+    LOG( "    Draw calls per frame: " + to_string( (double)Statistics.DrawCalls / Frames ) );
+    LOG( "    Quads per draw call: " + to_string( (double)Statistics.Quads / Statistics.DrawCalls ) );
+    LOG( "    Vertex buffer orphans: " + to_string( Statistics.BufferOrphans ) );
+    LOG( "    State changes per frame: " + to_string( (double)Statistics.StateChanges / Frames ) );
+    
+    unsigned RetainedBatches = Statistics.RetainedHits + Statistics.RetainedMisses;
+    
+    if( RetainedBatches > 0 )
+      LOG( "    Retained batches: " + to_string( Statistics.RetainedHits ) + " reused, " + to_string( Statistics.RetainedMisses )
+         + " updated (" + to_string( 100.0 * Statistics.RetainedHits / RetainedBatches ) + "% reused)" );
+    
+    if( Statistics.TextureUploads > 0 )
+      LOG( "    Texture uploads: " + to_string( Statistics.TextureUploads ) + ", evictions: " + to_string( Statistics.TextureEvictions )
+         + ", stalled frames: " + to_string( Statistics.TextureStalls ) );
+    
+    if( Statistics.OccludedQuads > 0 || Statistics.SkippedClears > 0 )
+      LOG( "    Occluded quads: " + to_string( Statistics.OccludedQuads ) + ", skipped clears: " + to_string( Statistics.SkippedClears ) );
+    
+    LOG( "    Frames with previous contents invalidated: " + to_string( Statistics.InvalidatedFrames )
+       + ", preserved: " + to_string( Statistics.PreservedFrames ) );
+    LOG( "    Texture binds per frame: " + to_string( (double)Statistics.TextureBinds / Frames ) );
+    LOG( "    Sent to GPU: " + to_string( Statistics.VertexBytes / 1024 ) + " KB of vertices, "
+       + to_string( Statistics.TextureBytes / 1024 ) + " KB of textures" );
+    
+    string Flushes;
+    
+    for( int i = 0; i < NUMBER_OF_FLUSH_REASONS; i++ )
+      Flushes += string(i? ", " : "") + flush_reason_names[ i ] + " " + to_string( Statistics.Flushes[ i ] );
+    
+    LOG( "    Flushes by cause: " + Flushes );
+    
+    if( Statistics.OpenGLErrors > 0 )
+      LOG( "    OpenGL errors: " + to_string( Statistics.OpenGLErrors ) );
+    
+    EmulationStatistics Recorded = Emulation.GetTotalStatistics();
+    
+    if( !Recorded.Frames )
+      return;
+    
+    LOG( "Recorded frames statistics:" );
+    LOG( "    Presented frames: " + to_string( Recorded.Frames ) );
+    LOG( "    Commands per frame: " + to_string( (double)Recorded.Commands / Recorded.Frames ) );
+    
+    if( skip_duplicate_frames )
+      LOG( "    Duplicate frames: " + to_string( Recorded.DuplicateFrames ) + " ("
+         + to_string( 100.0 * Recorded.DuplicateFrames / Recorded.Frames ) + "%)" );
+    
+    string EmulationThreadName = (Emulation.IsThreaded()? "emulation thread" : "front-end thread");
+    LOG( "    Emulation time per frame: " + to_string( Recorded.EmulationMilliseconds / Recorded.Frames ) + " ms (" + EmulationThreadName + ")" );
+    LOG( "    Present time per frame: " + to_string( Recorded.PresentMilliseconds / Recorded.Frames ) + " ms (front-end thread)" );
+    LOG( "    Wait time per frame: " + to_string( Recorded.WaitMilliseconds / Recorded.Frames ) + " ms (front-end thread)" );
+    LOG( "    Input to video latency: " + to_string( Recorded.LatencyMilliseconds / Recorded.Frames ) + " ms average, "
+       + to_string( Recorded.MaximumLatencyMilliseconds ) + " ms maximum" );
+}
+
+// -----------------------------------------------------------------------------
+
+void StopCapture()
+{
+    if( !Capture.IsActive() )
+      return;
+    
+    Capture.Stop();
+    CaptureStatistics Statistics = Capture.GetStatistics();
+    
+    LOG( "Capture statistics:" );
+    LOG( "    Frames: " + to_string( Statistics.CapturedFrames ) + " captured, " + to_string( Statistics.WrittenFrames )
+       + " written, " + to_string( Statistics.DroppedFrames ) + " dropped" );
+    LOG( "    Overhead per frame: " + to_string( Statistics.AverageOverheadMilliseconds ) + " ms average, "
+       + to_string( Statistics.MaximumOverheadMilliseconds ) + " ms maximum" );
+}
+
 
 // =============================================================================
 //      ROUTINE FOR LOADING VIRCON32 BIOS
@@ -430,33 +1091,12 @@ void LoadVircon32Bios()
 }
 
 
-// =============================================================================
-//      HANDLING CONTEXT FOR CORE AND OPENGL
-// =============================================================================
-
+// -----------------------------------------------------------------------------
 
-void context_reset()
+// sets the console clock and loads the BIOS and
+// any cartridge; video callbacks must be set first
+void LoadConsoleContents()
 {
-    LOG( "Received signal: Reset context" );
-    rglgen_resolve_symbols( hw_render.get_proc_address );
-    
-    // initialize video output
-    Video.InitRendering();
-    
-    // set console's video callbacks
-    V32::Callbacks::ClearScreen = CallbackFunctions::ClearScreen;
-    V32::Callbacks::DrawQuad = CallbackFunctions::DrawQuad;
-    V32::Callbacks::SetMultiplyColor = CallbackFunctions::SetMultiplyColor;
-    V32::Callbacks::SetBlendingMode = CallbackFunctions::SetBlendingMode;
-    V32::Callbacks::SelectTexture = CallbackFunctions::SelectTexture;
-    V32::Callbacks::LoadTexture = CallbackFunctions::LoadTexture;
-    V32::Callbacks::UnloadCartridgeTextures = CallbackFunctions::UnloadCartridgeTextures;
-    V32::Callbacks::UnloadBiosTexture = CallbackFunctions::UnloadBiosTexture;
-    
-    // set console's log callbacks
-    V32::Callbacks::LogLine = CallbackFunctions::LogLine;
-    V32::Callbacks::ThrowException = CallbackFunctions::ThrowException;
-    
     // obtain current time
     time_t CreationTime;
     time( &CreationTime );
@@ -496,18 +1136,153 @@ void context_reset()
     }
 }
 
+
+// =============================================================================
+//      HANDLING CONTEXT FOR CORE AND OPENGL
+// =============================================================================
+
+
+// textures are kept by the video output when the context
+// is lost, so the game continues where it was (only the
+// GL objects are created again, not the console contents)
+void context_reset()
+{
+    LOG( "Received signal: Reset context" );
+    auto StartTime = std::chrono::steady_clock::now();
+    rglgen_resolve_symbols( hw_render.get_proc_address );
+    
+    // this also creates all textures loaded so far
+    Video.InitRendering();
+    
+    // region drawings are only given to the video output
+    // when it can transform them (i.e. instanced rendering)
+    bool record_frames = enable_threaded_rendering || skip_duplicate_frames;
+    
+    if( Video.IsInstancingEnabled() )
+      V32::Callbacks::DrawRegion = (record_frames? RecordingCallbackFunctions::DrawRegion : CallbackFunctions::DrawRegion);
+    else
+      V32::Callbacks::DrawRegion = nullptr;
+    
+    TextureMemoryStatistics TextureMemory = Video.GetTextureMemoryStatistics();
+    LOG( "Texture memory: " + to_string( TextureMemory.StoredBytes / 1024 ) + " KB for "
+       + to_string( TextureMemory.Textures ) + " textures" );
+    LOG( "Palettized textures: " + to_string( TextureMemory.PalettizedTextures ) + " of "
+       + to_string( TextureMemory.Textures ) + ", saving " + to_string( TextureMemory.SavedBytes / 1024 ) + " KB" );
+    
+    // after a context reset the front-end has no previous frame
+    last_frame_valid = false;
+    
+    if( record_frames )
+      Emulation.Start( enable_threaded_rendering );
+    
+    // capture needs the GL context to read frames
+    if( enable_capture )
+      Capture.Start( GetCaptureBasePath( LoadedCartridgePath ) );
+    
+    double Milliseconds = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - StartTime ).count();
+    LOG( "Context reset took " + to_string( Milliseconds ) + " ms" );
+}
+
 // -----------------------------------------------------------------------------
 
 void context_destroy()
 {
     LOG( "Received signal: Destroy context" );
-    Console.UnloadCartridge();
-    Console.UnloadBios();
+    Emulation.Stop();
+    StopCapture();
     Video.Destroy();
 }
 
 // -----------------------------------------------------------------------------
 
+// the software renderer needs no context, so the
+// console can be set up as soon as a game is loaded
+void init_software_renderer()
+{
+    LOG( "Using software renderer" );
+    UseSoftwareRendering = true;
+    
+    unsigned Threads = software_renderer_threads;
+    
+    if( !Threads )
+      Threads = max( 1u, std::thread::hardware_concurrency() );
+    
+    SoftwareVideo.Initialize( Threads );
+    
+    // set console's video callbacks
+    V32::Callbacks::ClearScreen = SoftwareCallbackFunctions::ClearScreen;
+    V32::Callbacks::DrawQuad = SoftwareCallbackFunctions::DrawQuad;
+    V32::Callbacks::SetMultiplyColor = SoftwareCallbackFunctions::SetMultiplyColor;
+    V32::Callbacks::SetBlendingMode = SoftwareCallbackFunctions::SetBlendingMode;
+    V32::Callbacks::SelectTexture = SoftwareCallbackFunctions::SelectTexture;
+    V32::Callbacks::LoadTexture = SoftwareCallbackFunctions::LoadTexture;
+    V32::Callbacks::UnloadCartridgeTextures = SoftwareCallbackFunctions::UnloadCartridgeTextures;
+    V32::Callbacks::UnloadBiosTexture = SoftwareCallbackFunctions::UnloadBiosTexture;
+    V32::Callbacks::ReserveCartridgeTextures = nullptr;
+    V32::Callbacks::ShareTexture = SoftwareCallbackFunctions::ShareTexture;
+    V32::Callbacks::DrawRegion = nullptr;
+    
+    // set console's log callbacks
+    V32::Callbacks::LogLine = CallbackFunctions::LogLine;
+    V32::Callbacks::ThrowException = CallbackFunctions::ThrowException;
+    
+    LoadConsoleContents();
+    
+    // capture reads frames from the OpenGL framebuffer
+    if( enable_capture )
+      LOG( "Capture is not available with the software renderer" );
+}
+
+// -----------------------------------------------------------------------------
+
+// with OpenGL the console is also set up when a game is
+// loaded; textures are kept by the video output until
+// there is a context (see context_reset)
+void init_hardware_renderer()
+{
+    // video output modes are needed to load textures
+    Video.SetTextureArrayMode( enable_texture_array );
+    Video.SetPremultipliedAlphaMode( enable_premultiplied_alpha );
+    Video.SetInstancingMode( enable_instanced_rendering );
+    Video.SetRetainedBatchMode( enable_retained_batches );
+    Video.SetPaletteMode( enable_palettized_textures );
+    Video.SetTextureMemoryBudget( (uint64_t)texture_memory_budget * 1024 * 1024 );
+    
+    // set console's video callbacks
+    V32::Callbacks::ClearScreen = CallbackFunctions::ClearScreen;
+    V32::Callbacks::DrawQuad = CallbackFunctions::DrawQuad;
+    V32::Callbacks::SetMultiplyColor = CallbackFunctions::SetMultiplyColor;
+    V32::Callbacks::SetBlendingMode = CallbackFunctions::SetBlendingMode;
+    V32::Callbacks::SelectTexture = CallbackFunctions::SelectTexture;
+    V32::Callbacks::LoadTexture = CallbackFunctions::LoadTexture;
+    V32::Callbacks::UnloadCartridgeTextures = CallbackFunctions::UnloadCartridgeTextures;
+    V32::Callbacks::UnloadBiosTexture = CallbackFunctions::UnloadBiosTexture;
+    V32::Callbacks::ReserveCartridgeTextures = CallbackFunctions::ReserveCartridgeTextures;
+    V32::Callbacks::ShareTexture = CallbackFunctions::ShareTexture;
+    
+    // (this depends on the context, see context_reset)
+    V32::Callbacks::DrawRegion = nullptr;
+    
+    // with the emulation thread, or to find duplicate
+    // frames, draws are recorded and then replayed
+    if( enable_threaded_rendering || skip_duplicate_frames )
+    {
+        V32::Callbacks::ClearScreen = RecordingCallbackFunctions::ClearScreen;
+        V32::Callbacks::DrawQuad = RecordingCallbackFunctions::DrawQuad;
+        V32::Callbacks::SetMultiplyColor = RecordingCallbackFunctions::SetMultiplyColor;
+        V32::Callbacks::SetBlendingMode = RecordingCallbackFunctions::SetBlendingMode;
+        V32::Callbacks::SelectTexture = RecordingCallbackFunctions::SelectTexture;
+    }
+    
+    // set console's log callbacks
+    V32::Callbacks::LogLine = CallbackFunctions::LogLine;
+    V32::Callbacks::ThrowException = CallbackFunctions::ThrowException;
+    
+    LoadConsoleContents();
+}
+
+// -----------------------------------------------------------------------------
+
 bool retro_init_hw_context()
 {
     LOG( "Received signal: Init HW context" );
@@ -620,6 +1395,11 @@ void retro_deinit()
 void retro_reset()
 {
     LOG( "Received signal: Reset" );
+    
+    // the frame emulated ahead is not shown
+    if( Emulation.IsRunning() )
+      Emulation.DiscardFrame();
+    
     Console.Reset();
 }
 
@@ -652,13 +1432,39 @@ bool retro_load_game( const struct retro_game_info *info )
         return false;
     }
     
-    // initialize our context
-    if( !retro_init_hw_context() )
+    // initialize our context; when there is no OpenGL
+    // support we can still use the software renderer
+    UseSoftwareRendering = enable_software_renderer;
+    
+    if( !UseSoftwareRendering && !retro_init_hw_context() )
     {
-        LOG( "ERROR: HW Context could not be initialized" );
-        return false;
+        LOG( "HW Context could not be initialized, falling back to software renderer" );
+        UseSoftwareRendering = true;
     }
     
+    // duplicate frames can only be skipped
+    // if the front-end accepts them
+    skip_duplicate_frames = false;
+    
+    if( enable_duplicate_frames && !UseSoftwareRendering )
+    {
+        bool can_dupe = false;
+        
+        if( environ_cb( RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe ) && can_dupe )
+          skip_duplicate_frames = true;
+        else
+          LOG( "Duplicate frames will be drawn because frontend does not support skipping them" );
+    }
+    
+    // choose how audio is sent to the front-end
+    Resampler.Configure( audio_output_rate, audio_resampler_quality );
+    Resampler.ResetStatistics();
+    Console.SPU.ResetMixingStatistics();
+    configure_audio_callback();
+    
+    if( !Resampler.IsBypassed() )
+      LOG( "Audio will be resampled to " + to_string( audio_output_rate ) + " Hz" );
+    
     // case 1: core loaded with a game
     if( info && info->path )
     {
@@ -677,6 +1483,11 @@ bool retro_load_game( const struct retro_game_info *info )
         LoadedCartridgePath = "";
     }
     
+    if( UseSoftwareRendering )
+      init_software_renderer();
+    else
+      init_hardware_renderer();
+    
     return true;
 }
 
@@ -686,8 +1497,19 @@ void retro_unload_game()
 {
     LOG( "Received signal: Unload game" );
     
+    // statistics include the frame emulated ahead
+    Emulation.WaitForFrame();
+    log_video_statistics();
+    log_audio_statistics();
+    Emulation.Stop();
+    StopCapture();
+    
     Console.UnloadCartridge();
     Console.UnloadMemoryCard();
+    Console.UnloadBios();
+    
+    if( UseSoftwareRendering )
+      SoftwareVideo.Destroy();
 }
 
 // -----------------------------------------------------------------------------
@@ -733,6 +1555,7 @@ size_t retro_serialize_size()
     // savestates may be a different size for each
     // game, that is fine by libretro as long as
     // that size is always the same for each game
+    Emulation.WaitForFrame();
     unsigned UnusedCartridgeTextures = V32::Constants::GPUMaximumCartridgeTextures;
     
     if( Console.HasCartridge() )
@@ -752,6 +1575,8 @@ bool retro_serialize( void *data, size_t size )
         return false;
     }
     
+    // (when threaded, this includes the frame emulated ahead)
+    Emulation.WaitForFrame();
     return SaveState( (ConsoleState*)data );
 }
 
@@ -766,6 +1591,10 @@ bool retro_unserialize( const void *data, size_t size )
         return false;
     }
     
+    // the frame emulated ahead is not shown
+    if( Emulation.IsRunning() )
+      Emulation.DiscardFrame();
+    
     return LoadState( (const ConsoleState*)data );
 }
 